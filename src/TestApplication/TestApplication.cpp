@@ -39,10 +39,44 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
     using ItSoftware::macOS::ItsCreateIDOptions;
     using ItSoftware::macOS::Core::ItsTimer;
     using ItSoftware::macOS::Core::ItsFile;
+    using ItSoftware::macOS::Core::ItsFileAccessHint;
+    using ItSoftware::macOS::Core::ItsFileCopyOptions;
+    using ItSoftware::macOS::Core::ItsFileCopyResult;
+    using ItSoftware::macOS::Core::ItsFileCopyStrategy;
+    using ItSoftware::macOS::Core::ItsFileResumableCopyOptions;
+    using ItSoftware::macOS::Core::ItsHashAlgorithm;
+    using ItSoftware::macOS::Core::ItsRateLimiter;
+    using ItSoftware::macOS::Core::ItsShredOptions;
+    using ItSoftware::macOS::Core::ItsShredPattern;
+    using ItSoftware::macOS::Core::ItsShredResult;
+    using ItSoftware::macOS::Core::ItsAlignedBuffer;
+    using ItSoftware::macOS::Core::ItsAlignedBufferPool;
+    using ItSoftware::macOS::Core::ItsBufferedFile;
+    using ItSoftware::macOS::Core::ItsBufferedFileOptions;
+    using ItSoftware::macOS::Core::ItsMappedFile;
+    using ItSoftware::macOS::Core::ItsMappedFileAccess;
+    using ItSoftware::macOS::Core::ItsMappedFileAdvice;
     using ItSoftware::macOS::Core::ItsGuid;
     using ItSoftware::macOS::Core::ItsGuidFormat;
     using ItSoftware::macOS::Core::ItsPath;
     using ItSoftware::macOS::Core::ItsDirectory;
+    using ItSoftware::macOS::Core::ItsDirectoryEntry;
+    using ItSoftware::macOS::Core::ItsDirectoryEntryType;
+    using ItSoftware::macOS::Core::ItsDirectoryReader;
+    using ItSoftware::macOS::Core::ItsDirectoryListing;
+    using ItSoftware::macOS::Core::ItsDirectoryWalkEntry;
+    using ItSoftware::macOS::Core::ItsDirectoryWalkOptions;
+    using ItSoftware::macOS::Core::ItsDirectoryWalkResult;
+    using ItSoftware::macOS::Core::ItsDirectoryUsageResult;
+    using ItSoftware::macOS::Core::ItsDirectoryRemoveOptions;
+    using ItSoftware::macOS::Core::ItsDirectoryRemoveResult;
+    using ItSoftware::macOS::Core::ItsDirectorySnapshot;
+    using ItSoftware::macOS::Core::ItsDirectorySnapshotDiff;
+    using ItSoftware::macOS::Core::ItsDirectoryHandle;
+    using ItSoftware::macOS::Core::ItsMetadataOperation;
+    using ItSoftware::macOS::Core::ItsMetadataRequest;
+    using ItSoftware::macOS::Core::ItsMetadataBatch;
+    using ItSoftware::macOS::Core::ItsMetadataCache;
     using ItSoftware::macOS::Core::ItsError;
     using ItSoftware::macOS::Core::ItsFileMonitor;
     using ItSoftware::macOS::Core::ItsFileMonitorEvent;
@@ -59,6 +93,10 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
     void TestItsTimerStart();
     void TestItsTimerStop();
     void TestItsFile();
+    bool TestItsFileSparseCopy();
+    void TestItsMappedFile();
+    void TestItsBufferedFile();
+    void TestItsFileDirectIO();
     void TestItsDateTime();
     void TestItsID();
     void TestItsGuid();
@@ -86,6 +124,12 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
     char g_filename[] = "/Users/kjetilso/test.txt";
     char g_copyToFilename[] = "/Users/kjetilso/test2.txt";
     char g_shredFilename[] = "/Users/kjetilso/test2shred.txt";
+    char g_mappedFilename[] = "/Users/kjetilso/test3mapped.txt";
+    char g_sparseFilename[] = "/Users/kjetilso/test4sparse.bin";
+    char g_sparseCopyFilename[] = "/Users/kjetilso/test5sparse.bin";
+    char g_bufferedFilename[] = "/Users/kjetilso/test6buffered.bin";
+    char g_directFilename[] = "/Users/kjetilso/test7direct.bin";
+    char g_snapshotFilename[] = "/Users/kjetilso/test8snapshot.bin";
     string g_path1("/Users");
     string g_path2("/kjetilso/test.txt");
     string g_invalidPath("Users\0/kjetilso");
@@ -124,6 +168,9 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
         TestItsString();
         TestItsLog();
         TestItsFile();
+        TestItsMappedFile();
+        TestItsBufferedFile();
+        TestItsFileDirectIO();
         TestItsDateTime();
         TestItsID();
         TestItsGuid();
@@ -421,6 +468,17 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
         cout << "> Success. " << written << " bytes written to " << g_filename << endl;
         
 
+        cout << "file.Advise(ItsFileAccessHint::Sequential)" << endl;
+        if (!file.Advise(ItsFileAccessHint::Sequential)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success" << endl;
+
+        cout << "ItsFile::Prefetch({ g_filename })" << endl;
+        cout << "> " << ItsFile::Prefetch({ g_filename }) << " file(s) prefetched" << endl;
+
         string str;
         cout << "file.ReadAllText(str)" << endl;
         if (!file.ReadAllText(str)) {
@@ -429,8 +487,48 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
             return;
         }
         cout << "> Success. Read all text from file " << g_filename << endl;
+
+        size_t lineCount(0);
+        cout << "file.ForEachLine([&](std::string_view line) { ... })" << endl;
+        if (!file.ForEachLine([&](std::string_view line) { lineCount++; return true; })) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. Streamed " << lineCount << " lines from file " << g_filename << endl;
         
 
+        char head[5] = {0};
+        char tail[7] = {0};
+        vector<struct iovec> buffers{ {head, 4}, {tail, 6} };
+        size_t bytesRead(0);
+        cout << "file.ReadVAt(buffers, 5, &bytesRead)" << endl;
+        if (!file.ReadVAt(buffers, 5, &bytesRead)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. " << bytesRead << " bytes read into '" << head << "' and '" << tail << "'" << endl;
+
+        char asyncText[] = "Async Line 3\n";
+        cout << "file.WriteAsync(asyncText, strlen(asyncText), written).get()" << endl;
+        auto asyncResult = file.WriteAsync(asyncText, strlen(asyncText), static_cast<off_t>(written)).get();
+        if (asyncResult.error != 0) {
+            cout << "> FAILED: " << ItsError::GetErrorDescription(asyncResult.error) << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. " << asyncResult.bytes << " bytes written asynchronously to " << g_filename << endl;
+
+        cout << "file.FsyncAsync().get()" << endl;
+        asyncResult = file.FsyncAsync().get();
+        if (asyncResult.error != 0) {
+            cout << "> FAILED: " << ItsError::GetErrorDescription(asyncResult.error) << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success" << endl;
+
         cout << "file.Close()" << endl;
         if (!file.Close() ) {
             cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;;
@@ -452,7 +550,91 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
             return;
         }
         cout << "> Success. File " << g_filename << " successfully copied to " << g_copyToFilename << endl;
+
+        ItsFileCopyOptions copyOptions;
+        copyOptions.replaceIfExists = true;
+        ItsFileCopyResult copyResult;
+        cout << "ItsFile::Copy(g_filename, g_copyToFilename, copyOptions, &copyResult)" << endl;
+        if (!ItsFile::Copy(g_filename, g_copyToFilename, copyOptions, &copyResult)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. " << copyResult.bytesCopied << " bytes copied using strategy ";
+        switch (copyResult.strategy) {
+            case ItsFileCopyStrategy::Clone: cout << "Clone" << endl; break;
+            case ItsFileCopyStrategy::CopyFile: cout << "CopyFile" << endl; break;
+            case ItsFileCopyStrategy::ReadWrite: cout << "ReadWrite" << endl; break;
+            default: cout << "None" << endl; break;
+        }
         
+        copyOptions.verify = true;
+        cout << "ItsFile::Copy(g_filename, g_copyToFilename, copyOptions { verify = true }, &copyResult)" << endl;
+        if (!ItsFile::Copy(g_filename, g_copyToFilename, copyOptions, &copyResult) || !copyResult.verified) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. Copy verified, CRC32C " << std::hex << copyResult.digest << std::dec << endl;
+
+        uint64_t digest(0);
+        cout << "ItsFile::Hash(g_copyToFilename, ItsHashAlgorithm::XxHash64, &digest)" << endl;
+        if (!ItsFile::Hash(g_copyToFilename, ItsHashAlgorithm::XxHash64, &digest)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. XXH64 " << std::hex << digest << std::dec << endl;
+
+        cout << "ItsFile::Copy(g_sparseFilename, g_sparseCopyFilename, sparseOptions, &copyResult)" << endl;
+        if (!TestItsFileSparseCopy()) {
+            cout << endl;
+            return;
+        }
+
+        cout << R"(ItsFile::ReplaceAtomic(g_copyToFilename, string("Replaced\n"), ItsFile::CreateMode("rw","rw","rw")))" << endl;
+        if (!ItsFile::ReplaceAtomic(g_copyToFilename, string("Replaced\n"), ItsFile::CreateMode("rw","rw","rw"))) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. File " << g_copyToFilename << " atomically replaced" << endl;
+
+        ItsFileCopyOptions deltaOptions;
+        deltaOptions.replaceIfExists = true;
+        deltaOptions.delta = true;
+        cout << "ItsFile::Copy(g_filename, g_copyToFilename, deltaOptions, &copyResult)" << endl;
+        if (!ItsFile::Copy(g_filename, g_copyToFilename, deltaOptions, &copyResult)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. " << copyResult.bytesCopied << " bytes written, " << copyResult.bytesSkipped << " bytes skipped" << endl;
+
+        ItsRateLimiter limiter(1024 * 1024, 100);
+        ItsFileCopyOptions throttledOptions;
+        throttledOptions.replaceIfExists = true;
+        throttledOptions.rateLimiter = &limiter;
+        size_t progressCalls(0);
+        throttledOptions.progress = [&](uint64_t bytesDone, uint64_t bytesTotal) { progressCalls++; };
+        cout << "ItsFile::Copy(g_filename, g_copyToFilename, throttledOptions { 1 MB/s, 100 IOPS }, &copyResult)" << endl;
+        if (!ItsFile::Copy(g_filename, g_copyToFilename, throttledOptions, &copyResult)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. " << copyResult.bytesCopied << " bytes copied, " << progressCalls << " progress calls" << endl;
+
+        ItsFileResumableCopyOptions resumableOptions;
+        resumableOptions.replaceIfExists = true;
+        cout << "ItsFile::CopyResumable(g_filename, g_copyToFilename, resumableOptions, &copyResult)" << endl;
+        if (!ItsFile::CopyResumable(g_filename, g_copyToFilename, resumableOptions, &copyResult)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. " << copyResult.bytesCopied << " bytes copied, " << copyResult.bytesSkipped << " bytes resumed" << endl;
+
         cout << "ItsFile::Exists(g_copyToFilename)" << endl;
         if (!ItsFile::Exists(g_copyToFilename)) {
             cout << "> File " << g_copyToFilename << " does not exist" << endl;
@@ -469,6 +651,20 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
         }
         cout << "> Success. File " << g_copyToFilename << " deleted" << endl;
 
+        ItsShredOptions shredOptions;
+        shredOptions.passes = { ItsShredPattern::Random, ItsShredPattern::Zeros };
+        ItsShredResult shredResult;
+        cout << "ItsFile::Shred(g_shredFilename, shredOptions, &shredResult)" << endl;
+        if (!ItsFile::Shred(g_shredFilename, shredOptions, &shredResult)) {
+            cout << "> FAILED: " << ItsError::GetErrorDescription(shredResult.error) << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. " << shredResult.passes.size() << " passes" << endl;
+        for (auto& pass : shredResult.passes) {
+            cout << ">> " << pass.bytesWritten << " bytes at " << pass.GetMegabytesPerSecond() << " MB/s" << endl;
+        }
+
         cout << "ItsFile::Shred(g_shredFilename,true)" << endl;
         if (!ItsFile::Shred(g_shredFilename, true)) {
             cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
@@ -480,6 +676,235 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
         cout << endl;
     }
 
+    //
+    // Function: TestItsFileSparseCopy
+    //
+    // (i): Test of sparse preserving ItsFile::Copy. Compares st_blocks of source and target.
+    //
+    bool TestItsFileSparseCopy()
+    {
+        ItsFile sparse;
+        if (!sparse.OpenOrCreate(g_sparseFilename, "rwt", ItsFile::CreateMode("rw","rw","rw"))) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            return false;
+        }
+
+        // 64 MiB file with a single 4 KiB data block in the middle
+        char block[4096];
+        memset(block, 'S', sizeof(block));
+        size_t written(0);
+        if (ftruncate(sparse, 64 * 1024 * 1024) != 0 ||
+            !sparse.SetPosFromBeg(32 * 1024 * 1024) ||
+            !sparse.Write(block, sizeof(block), &written)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            return false;
+        }
+        sparse.Close();
+
+        ItsFileCopyOptions sparseOptions;
+        sparseOptions.replaceIfExists = true;
+        sparseOptions.allowClone = false;
+        sparseOptions.preserveSparse = true;
+        ItsFileCopyResult copyResult;
+        if (!ItsFile::Copy(g_sparseFilename, g_sparseCopyFilename, sparseOptions, &copyResult)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            ItsFile::Delete(g_sparseFilename);
+            return false;
+        }
+
+        struct stat sourceStat;
+        struct stat targetStat;
+        stat(g_sparseFilename, &sourceStat);
+        stat(g_sparseCopyFilename, &targetStat);
+        ItsFile::Delete(g_sparseFilename);
+        ItsFile::Delete(g_sparseCopyFilename);
+
+        if (sourceStat.st_size != targetStat.st_size || targetStat.st_blocks > sourceStat.st_blocks) {
+            cout << "> FAILED. Source st_blocks " << sourceStat.st_blocks << ", target st_blocks " << targetStat.st_blocks << endl;
+            return false;
+        }
+        cout << "> Success. " << copyResult.bytesCopied << " data bytes copied. Source st_blocks " << sourceStat.st_blocks << ", target st_blocks " << targetStat.st_blocks << endl;
+        return true;
+    }
+
+    //
+    // Function: TestItsMappedFile
+    //
+    // (i): Test of ItsMappedFile.
+    //
+    void TestItsMappedFile()
+    {
+        PrintTestHeader("ItsMappedFile");
+
+        ItsMappedFile mf;
+        cout << R"(mf.OpenExisting(g_filename, ItsMappedFileAccess::ReadOnly))" << endl;
+        if (!mf.OpenExisting(g_filename, ItsMappedFileAccess::ReadOnly)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. Mapped " << mf.GetSize() << " bytes of " << g_filename << endl;
+
+        cout << "mf.Advise(ItsMappedFileAdvice::Sequential)" << endl;
+        if (!mf.Advise(ItsMappedFileAdvice::Sequential)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+        }
+        else {
+            cout << "> Success" << endl;
+        }
+
+        auto view = mf.GetView();
+        cout << "mf.GetView()" << endl;
+        cout << "> Success. Lines in view: " << std::count(view.begin(), view.end(), '\n') << endl;
+        mf.Close();
+
+        cout << R"(mf.OpenOrCreate(g_mappedFilename, ItsFile::CreateMode("rw","rw","rw"), 4096))" << endl;
+        if (!mf.OpenOrCreate(g_mappedFilename, ItsFile::CreateMode("rw","rw","rw"), 4096)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        memset(mf.GetMutableData(), 'A', mf.GetSize());
+        cout << "> Success" << endl;
+
+        cout << "mf.Resize(8192)" << endl;
+        if (!mf.Resize(8192)) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        memset(mf.GetMutableData() + 4096, 'B', 4096);
+        cout << "> Success. Size is now " << mf.GetSize() << endl;
+
+        cout << "mf.Flush()" << endl;
+        if (!mf.Flush()) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success" << endl;
+        mf.Close();
+
+        cout << "ItsFile::GetFileSize(g_mappedFilename)" << endl;
+        cout << "> " << ItsFile::GetFileSize(g_mappedFilename) << " bytes" << endl;
+        ItsFile::Delete(g_mappedFilename);
+
+        cout << endl;
+    }
+
+    //
+    // Function: TestItsBufferedFile
+    //
+    // (i): Test of ItsBufferedFile. Benchmarks buffered against raw ItsFile::Write
+    //      for 16 byte to 4 KiB records.
+    //
+    void TestItsBufferedFile()
+    {
+        PrintTestHeader("ItsBufferedFile");
+
+        const size_t totalBytes = 4 * 1024 * 1024;
+        vector<uint8_t> record(4096, 'R');
+        for (size_t recordSize : { 16, 64, 256, 1024, 4096 }) {
+            size_t records = totalBytes / recordSize;
+
+            ItsTimer timer;
+            ItsFile raw;
+            if (!raw.OpenOrCreate(g_bufferedFilename, "wt", ItsFile::CreateMode("rw","rw","rw"))) {
+                cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+                cout << endl;
+                return;
+            }
+            size_t written(0);
+            timer.Start();
+            for (size_t i = 0; i < records; i++) {
+                raw.Write(record.data(), recordSize, &written);
+            }
+            raw.Close();
+            timer.Stop();
+            int64_t rawUs = std::max<int64_t>(1, timer.GetMicroseconds());
+
+            ItsBufferedFileOptions options;
+            options.bufferSize = 256 * 1024;
+            ItsBufferedFile buffered;
+            if (!buffered.OpenOrCreate(g_bufferedFilename, "wt", ItsFile::CreateMode("rw","rw","rw"), options)) {
+                cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+                cout << endl;
+                return;
+            }
+            timer.Start();
+            for (size_t i = 0; i < records; i++) {
+                buffered.Write(record.data(), recordSize);
+            }
+            buffered.Close();
+            timer.Stop();
+            int64_t bufferedUs = std::max<int64_t>(1, timer.GetMicroseconds());
+
+            cout << "Record size " << std::setfill(' ') << std::setw(4) << std::right << recordSize << std::left
+                 << ": raw " << (totalBytes / rawUs) << " MB/s, buffered " << (totalBytes / bufferedUs) << " MB/s" << endl;
+        }
+        ItsFile::Delete(g_bufferedFilename);
+
+        cout << endl;
+    }
+
+    //
+    // Function: TestItsFileDirectIO
+    //
+    // (i): Test of uncached ItsFile I/O with ItsAlignedBufferPool.
+    //      Benchmarks cached against uncached sequential reads.
+    //
+    void TestItsFileDirectIO()
+    {
+        PrintTestHeader("ItsFile Direct I/O");
+
+        const size_t fileSize = 64 * 1024 * 1024;
+        ItsFile file;
+        cout << R"(file.OpenOrCreate(g_directFilename, "wtd", ItsFile::CreateMode("rw","rw","rw")))" << endl;
+        if (!file.OpenOrCreate(g_directFilename, "wtd", ItsFile::CreateMode("rw","rw","rw"))) {
+            cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+            cout << endl;
+            return;
+        }
+        cout << "> Success. Block size is " << file.GetBlockSize() << " bytes" << endl;
+
+        ItsAlignedBufferPool pool(1024 * 1024, file.GetBlockSize());
+        {
+            ItsAlignedBuffer buffer(pool);
+            memset(buffer.GetData(), 'D', buffer.GetSize());
+            size_t written(0);
+            for (size_t total = 0; total < fileSize; total += buffer.GetSize()) {
+                file.Write(buffer.GetData(), buffer.GetSize(), &written);
+            }
+        }
+        file.Close();
+
+        for (string flags : { "r", "rd" }) {
+            ItsFile reader;
+            if (!reader.OpenExisting(g_directFilename, flags)) {
+                cout << "> FAILED: " << ItsError::GetLastErrorDescription() << endl;
+                cout << endl;
+                return;
+            }
+
+            ItsAlignedBuffer buffer(pool);
+            size_t bytesRead(0);
+            size_t totalRead(0);
+            ItsTimer timer;
+            timer.Start();
+            while (reader.Read(buffer.GetData(), buffer.GetSize(), &bytesRead) && bytesRead > 0) {
+                totalRead += bytesRead;
+            }
+            timer.Stop();
+            reader.Close();
+
+            cout << ((flags == "r") ? "Cached" : "Uncached") << " read of " << totalRead << " bytes: "
+                 << (totalRead / std::max<int64_t>(1, timer.GetMicroseconds())) << " MB/s" << endl;
+        }
+        ItsFile::Delete(g_directFilename);
+
+        cout << endl;
+    }
+
     //
     // Function: TestStartTimer
     //
@@ -679,6 +1104,146 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
             }
         }
 
+        cout << R"(ItsDirectory::Enumerate(g_directoryRoot, entries))" << endl;
+        vector<ItsDirectoryEntry> entries;
+        if (ItsDirectory::Enumerate(g_directoryRoot, entries)) {
+            cout << "> Success. Found " << entries.size() << " entries under " << g_directoryRoot << endl;
+            for (auto& e : entries) {
+                string type = (e.type == ItsDirectoryEntryType::Directory) ? "dir"
+                            : (e.type == ItsDirectoryEntryType::File) ? "file"
+                            : (e.type == ItsDirectoryEntryType::Symlink) ? "link" : "other";
+                cout << ">> " << std::setfill(' ') << std::setw(5) << std::left << type << " " << std::setw(12) << e.inode << " " << e.name << endl;
+            }
+        }
+        else {
+            cout << "> FAILED. Error: " << ItsError::GetLastErrorDescription() << endl;
+        }
+
+        cout << R"(for (auto& e : ItsDirectoryReader(g_directoryRoot)))" << endl;
+        ItsDirectoryReader reader(g_directoryRoot);
+        size_t readerCount = 0;
+        size_t readerNameBytes = 0;
+        for (auto& e : reader) {
+            readerCount++;
+            readerNameBytes += e.name.size();
+        }
+        if (reader.GetError() == 0) {
+            cout << "> Success. Read " << readerCount << " entries, " << readerNameBytes << " name bytes, without allocating per entry" << endl;
+        }
+        else {
+            cout << "> FAILED. Error: " << ItsError::GetErrorDescription(reader.GetError()) << endl;
+        }
+
+        cout << R"(ItsDirectoryListing::Load(g_directoryRoot))" << endl;
+        ItsDirectoryListing listing;
+        if (listing.Load(g_directoryRoot)) {
+            listing.SortByName();
+            cout << "> Success. Materialized " << listing.size() << " entries in a " << listing.GetArenaSize() << " byte name arena" << endl;
+            for (auto e : listing) {
+                cout << ">> " << e.name << endl;
+            }
+        }
+        else {
+            cout << "> FAILED. Error: " << ItsError::GetLastErrorDescription() << endl;
+        }
+
+        cout << R"(ItsDirectory::Walk(g_directoryRoot, callback, options, &walkResult))" << endl;
+        ItsDirectoryWalkOptions walkOptions;
+        walkOptions.maxDepth = 3;
+        walkOptions.sameFileSystem = true;
+        walkOptions.prune = [](const ItsDirectoryWalkEntry& e) { return e.name.size() > 0 && e.name[0] == '.'; };
+        std::atomic<uint64_t> walkFiles{0};
+        ItsDirectoryWalkResult walkResult;
+        ItsTimer walkTimer;
+        walkTimer.Start();
+        bool bWalk = ItsDirectory::Walk(g_directoryRoot, [&walkFiles](const ItsDirectoryWalkEntry& e) {
+            if (e.type == ItsDirectoryEntryType::File) {
+                walkFiles++;
+            }
+        }, walkOptions, &walkResult);
+        walkTimer.Stop();
+        if (bWalk) {
+            cout << "> Success. Walked " << walkResult.directories << " directories, " << walkResult.entries << " entries (" << walkFiles << " files, " << walkResult.errors << " errors) in " << (walkTimer.GetMicroseconds() / 1000) << " ms" << endl;
+        }
+        else {
+            cout << "> FAILED. Error: " << ItsError::GetLastErrorDescription() << endl;
+        }
+
+        cout << R"(ItsDirectory::GetUsage(g_directoryRoot, usage))" << endl;
+        ItsDirectoryUsageResult usage;
+        if (ItsDirectory::GetUsage(g_directoryRoot, usage)) {
+            cout << "> Success. " << usage.total.files << " files, " << usage.total.directories << " directories, "
+                 << usage.total.apparentSize << " bytes apparent, " << usage.total.allocatedSize << " bytes allocated" << endl;
+            for (auto& d : usage.directories) {
+                cout << ">> " << std::setfill(' ') << std::setw(14) << std::right << d.second.allocatedSize << std::left << " " << d.first << endl;
+            }
+        }
+        else {
+            cout << "> FAILED. Error: " << ItsError::GetLastErrorDescription() << endl;
+        }
+
+        cout << R"(ItsDirectoryHandle::Open(g_directoryRoot) + *at operations)" << endl;
+        ItsDirectoryHandle home;
+        ItsDirectoryHandle handleDir;
+        ItsFile handleFile;
+        size_t handleWritten(0);
+        vector<ItsDirectoryEntry> handleEntries;
+        if (home.Open(g_directoryRoot) &&
+            home.CreateDirectory("testhandle", ItsFile::CreateMode("rwx","rwx","rx")) &&
+            home.OpenDirectory("testhandle", handleDir) &&
+            handleDir.OpenOrCreateFile("a.txt", "wt", ItsFile::CreateMode("rw","rw","r"), handleFile) &&
+            handleFile.Write("handle\n", 7, &handleWritten) && handleFile.Close() &&
+            handleDir.Rename("a.txt", "b.txt") &&
+            handleDir.Exists("b.txt") &&
+            handleDir.Enumerate(handleEntries) &&
+            handleDir.Remove("b.txt") &&
+            home.Remove("testhandle", true)) {
+            cout << "> Success. Created, wrote, renamed, listed (" << handleEntries.size() << " entry) and removed relative to " << home.GetPath() << endl;
+        }
+        else {
+            cout << "> FAILED. Error: " << ItsError::GetLastErrorDescription() << endl;
+        }
+
+        cout << R"(ItsMetadataBatch::ExecuteBatch(requests) - mkdir, stat, rmdir)" << endl;
+        vector<ItsMetadataRequest> metadataRequests;
+        for (int i = 0; i < 1000; i++) {
+            ItsMetadataRequest request;
+            request.operation = ItsMetadataOperation::CreateDirectory;
+            request.path = g_creatDir + "batch" + std::to_string(i);
+            request.mode = ItsFile::CreateMode("rwx","rwx","rx");
+            metadataRequests.push_back(request);
+        }
+        ItsMetadataBatch metadataBatch;
+        size_t metadataFailed = 0;
+        for (auto operation : { ItsMetadataOperation::CreateDirectory, ItsMetadataOperation::Stat, ItsMetadataOperation::RemoveDirectory }) {
+            for (auto& request : metadataRequests) {
+                request.operation = operation;
+            }
+            for (auto& result : metadataBatch.ExecuteBatch(metadataRequests)) {
+                metadataFailed += (result.error != 0) ? 1 : 0;
+            }
+        }
+        if (metadataFailed == 0) {
+            cout << "> Success. " << metadataRequests.size() * 3 << " metadata operations in 3 batches" << endl;
+        }
+        else {
+            cout << "> FAILED. " << metadataFailed << " operations failed" << endl;
+        }
+
+        cout << R"(ItsMetadataCache::AddRoot(g_directoryRoot) + 10000 x FileExists(g_filename) / GetFiles(g_directoryRoot))" << endl;
+        ItsMetadataCache metadataCache;
+        if (!metadataCache.AddRoot(g_directoryRoot)) {
+            cout << "> Monitor not started, falling back to the ttl" << endl;
+        }
+        size_t cachedFound = 0;
+        for (int i = 0; i < 10000; i++) {
+            cachedFound += metadataCache.FileExists(g_filename) ? 1 : 0;
+            cachedFound += metadataCache.GetFiles(g_directoryRoot).size() > 0 ? 1 : 0;
+        }
+        auto cacheStatistics = metadataCache.GetStatistics();
+        cout << "> Success. " << cachedFound << " found, " << cacheStatistics.hits << " hits, " << cacheStatistics.misses << " misses, "
+             << cacheStatistics.invalidations << " invalidations, " << cacheStatistics.entries << " entries" << endl;
+
         auto cdir = g_creatDir;
         cout << R"(ItsDirectory::CreateDirectory(cdir))" << endl;
         bool bResult = ItsDirectory::CreateDirectory(cdir, ItsFile::CreateMode("rw","rw","rw"));
@@ -698,6 +1263,54 @@ namespace ItSoftware::CppIncludeMacOS::TestApplication
         }
         cout << "> Success removing directory " << cdir << endl;
 
+        int treeMode = ItsFile::CreateMode("rwx","rwx","rx");
+        ItsDirectory::CreateDirectory(cdir, treeMode);
+        for (int i = 0; i < 10; i++) {
+            string sub = cdir + "/sub" + std::to_string(i);
+            ItsDirectory::CreateDirectory(sub, treeMode);
+            ItsDirectory::CreateDirectory(sub + "/nested", treeMode);
+            for (int j = 0; j < 100; j++) {
+                ItsFile::ReplaceAtomic(sub + "/nested/file" + std::to_string(j), string("data\n"), ItsFile::CreateMode("rw","rw","r"));
+            }
+        }
+        cout << R"(ItsDirectorySnapshot::Capture(cdir) + Save(g_snapshotFilename) + Open(g_snapshotFilename))" << endl;
+        ItsDirectorySnapshot snapshot;
+        if (snapshot.Capture(cdir) && snapshot.Save(g_snapshotFilename, ItsFile::CreateMode("rw","rw","r")) && snapshot.Open(g_snapshotFilename)) {
+            cout << "> Success. Snapshot of " << snapshot.size() << " entries mapped from " << g_snapshotFilename << endl;
+
+            cout << R"(ItsDirectorySnapshot::Diff(snapshot, cdir, diff))" << endl;
+            ItsFile::ReplaceAtomic(cdir + "/sub0/nested/file0", string("changed\n"), ItsFile::CreateMode("rw","rw","r"));
+            ItsFile::Move(cdir + "/sub1/nested/file1", cdir + "/sub1/file1.moved");
+            ItsFile::Delete(cdir + "/sub2/nested/file2");
+            ItsFile::ReplaceAtomic(cdir + "/sub3/created", string("new\n"), ItsFile::CreateMode("rw","rw","r"));
+            ItsDirectorySnapshotDiff diff;
+            if (ItsDirectorySnapshot::Diff(snapshot, cdir, diff)) {
+                cout << "> Success. " << diff.created.size() << " created, " << diff.deleted.size() << " deleted, "
+                     << diff.modified.size() << " modified, " << diff.renamed.size() << " renamed" << endl;
+                for (auto& r : diff.renamed) {
+                    cout << ">> " << r.first << " -> " << r.second << endl;
+                }
+            }
+            else {
+                cout << "> FAILED. Error: " << ItsError::GetLastErrorDescription() << endl;
+            }
+            snapshot.Close();
+            ItsFile::Delete(g_snapshotFilename);
+        }
+        else {
+            cout << "> FAILED. Error: " << ItsError::GetLastErrorDescription() << endl;
+        }
+
+        cout << R"(ItsDirectory::RemoveTree(cdir, removeOptions, &removeResult))" << endl;
+        ItsDirectoryRemoveOptions removeOptions;
+        ItsDirectoryRemoveResult removeResult;
+        if (ItsDirectory::RemoveTree(cdir, removeOptions, &removeResult)) {
+            cout << "> Success. Removed " << removeResult.filesRemoved << " files and " << removeResult.directoriesRemoved << " directories" << endl;
+        }
+        else {
+            cout << "> FAILED. " << removeResult.errors << " errors. Error: " << ItsError::GetLastErrorDescription() << endl;
+        }
+
         cout << endl;
     }
 
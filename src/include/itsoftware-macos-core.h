@@ -18,6 +18,11 @@
 #include <sys/times.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <limits.h>
 #include <dirent.h>
 #include <iostream>
 #include <vector>
@@ -26,6 +31,25 @@
 #include <thread>
 #include <chrono>
 #include <functional>
+#include <string_view>
+#include <iterator>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+#include <deque>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <copyfile.h>
+#include <sys/clonefile.h>
+#include <sys/attr.h>
 #include <CoreServices/CoreServices.h>
 #include "itsoftware-macos.h"
 
@@ -232,84 +256,6 @@ namespace ItSoftware::macOS::Core
         }
     };
 
-    //
-    // struct: ItsDirectory
-    //
-    // (i): macOS directory routines.
-    //
-    struct ItsDirectory
-    {
-    public:
-        static bool Exists(string dirname)
-        {
-            struct stat sb;
-
-            if (stat(dirname.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode)) {
-                return true;
-            }
-
-            return false;
-        }
-        static bool CreateDirectory(string path, int mode)
-        {
-            return (mkdir(path.c_str(), mode) == 0);
-        }
-        static bool RemoveDirectory(string path)
-        {
-            return (rmdir(path.c_str()) == 0);
-        }
-        static bool SetCurrentDirectory(string path)
-        {
-            return (chdir(path.c_str()) == 0);
-        }
-        static vector<string> GetDirectories(string path) {
-            if (path.size() == 0) {
-                return vector<string>();
-            }
-
-            DIR *dir;
-            struct dirent *entry;
-
-            if ((dir = opendir(path.c_str())) == nullptr) {
-                return vector<string>();
-            }
-
-            vector<string> directories;
-            while ((entry = readdir(dir)) != nullptr) {
-                if (entry->d_type & DT_DIR) {
-                    directories.push_back(entry->d_name);
-                }
-            }
-
-            closedir(dir);
-            
-            return directories;
-        }
-        static vector<string> GetFiles(string path) {
-            if (path.size() == 0) {
-                return vector<string>();
-            }
-
-            DIR *dir;
-            struct dirent *entry;
-
-            if ((dir = opendir(path.c_str())) == nullptr) {
-                return vector<string>();
-            }
-
-            vector<string> files;
-            while ((entry = readdir(dir)) != nullptr) {
-                if (entry->d_type & DT_REG) {
-                    files.push_back(entry->d_name);
-                }
-            }
-
-            closedir(dir);
-            
-            return files;
-        }
-    };
-
     //
     // struct: unique_file_descriptor
     //
@@ -379,509 +325,6413 @@ namespace ItSoftware::macOS::Core
     };
 
     //
-    // File IO Wrapper
+    // class: ItsThreadPool
     //
-    class ItsFile
+    // (i): Fixed size worker thread pool.
+    //
+    class ItsThreadPool
     {
         private:
-        unique_file_handle m_fd;
-        string m_filename;
-        protected:
-        public:
-        ItsFile()
+        vector<thread> m_threads;
+        std::deque<function<void()>> m_queue;
+        std::mutex m_mutex;
+        std::condition_variable m_cvWork;
+        std::condition_variable m_cvIdle;
+        size_t m_active = 0;
+        bool m_bStopped = false;
+
+        void ExecuteWorkerThread()
         {
-        }
+            while (true)
+            {
+                function<void()> work;
+                {
+                    std::unique_lock<std::mutex> lock(this->m_mutex);
+                    this->m_cvWork.wait(lock, [this] { return this->m_bStopped || !this->m_queue.empty(); });
+                    if (this->m_queue.empty())
+                    {
+                        return;
+                    }
+                    work = std::move(this->m_queue.front());
+                    this->m_queue.pop_front();
+                    this->m_active++;
+                }
 
-        //
-        // GetFilename
-        //
-        string GetFilename()
-        {
-                return this->m_filename;
+                work();
+
+                {
+                    std::lock_guard<std::mutex> lock(this->m_mutex);
+                    this->m_active--;
+                    if (this->m_active == 0 && this->m_queue.empty())
+                    {
+                        this->m_cvIdle.notify_all();
+                    }
+                }
+            }
         }
 
+        protected:
+        public:
         //
-        // Method: OpenExisting
+        // (i) threadCount = 0 uses std::thread::hardware_concurrency.
         //
-        bool OpenExisting(string filename, string flags)
+        explicit ItsThreadPool(size_t threadCount = 0)
         {
-            if (this->m_fd.IsValid())
+            if (threadCount == 0)
             {
-                return false;
+                threadCount = std::max<size_t>(1, thread::hardware_concurrency());
             }
 
-            if (filename.size() == 0)
+            for (size_t i = 0; i < threadCount; i++)
             {
-                return false;
+                this->m_threads.push_back(thread(&ItsThreadPool::ExecuteWorkerThread, this));
             }
+        }
 
-            if (flags.size() == 0)
-            {
-                return false;
-            }
+        ItsThreadPool(const ItsThreadPool&) = delete;
+        ItsThreadPool& operator=(const ItsThreadPool&) = delete;
 
-            if (!ItsFile::Exists(filename))
+        //
+        // (i) runs all queued work, then joins the workers.
+        //
+        ~ItsThreadPool()
+        {
             {
-                return false;
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                this->m_bStopped = true;
             }
+            this->m_cvWork.notify_all();
 
-            int i_flags = 0;
-            if (flags.find("r") != string::npos &&
-                flags.find("w") != string::npos)
-            {
-                i_flags |= O_RDWR;
-            }
-            else if (flags.find("r") != string::npos)
-            {
-                i_flags |= O_RDONLY;
-            }
-            else if (flags.find("w") != string::npos)
+            for (auto& t : this->m_threads)
             {
-                i_flags |= O_WRONLY;
-            }
-            else
-            {
-                return false;
+                if (t.joinable())
+                {
+                    t.join();
+                }
             }
+        }
 
-            i_flags |= O_CREAT;
-            //i_flags |= O_LARGEFILE;
-
-            if (flags.find("t") != string::npos)
-            {
-                i_flags |= O_TRUNC;
-            }
-            else if (flags.find("a") != string::npos)
+        void Enqueue(function<void()> work)
+        {
             {
-                i_flags |= O_APPEND;
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                this->m_queue.push_back(std::move(work));
             }
+            this->m_cvWork.notify_one();
+        }
 
-            this->m_fd = open(filename.c_str(), i_flags);
-            if (this->m_fd.IsInvalid())
+        //
+        // Method: EnqueueBatch
+        //
+        // (i) queues many work items under a single lock.
+        //
+        void EnqueueBatch(vector<function<void()>>& work)
+        {
             {
-                return false;
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                for (auto& w : work)
+                {
+                    this->m_queue.push_back(std::move(w));
+                }
             }
+            work.clear();
+            this->m_cvWork.notify_all();
+        }
 
-            this->m_filename = filename;
-            return true;
+        template<typename F>
+        auto Submit(F func) -> std::future<decltype(func())>
+        {
+            auto task = std::make_shared<std::packaged_task<decltype(func())()>>(std::move(func));
+            auto future = task->get_future();
+            this->Enqueue([task]() { (*task)(); });
+            return future;
         }
 
         //
-        // Method: OpenOrCreate
+        // Method: WaitIdle
         //
-        // (i) mode = "rwta" (read, write, trunc, append)
+        // (i) blocks until the queue is empty and no work is running.
         //
-        bool OpenOrCreate(string filename, string flags, int mode)
+        void WaitIdle()
         {
-            if (this->m_fd.IsValid())
-            {
-                return false;
-            }
+            std::unique_lock<std::mutex> lock(this->m_mutex);
+            this->m_cvIdle.wait(lock, [this] { return this->m_active == 0 && this->m_queue.empty(); });
+        }
 
-            if (filename.size() == 0)
-            {
-                return false;
-            }
+        size_t GetThreadCount() const
+        {
+            return this->m_threads.size();
+        }
+    };
 
-            if (flags.size() == 0)
-            {
-                return false;
-            }
+    //
+    // class: ItsCancellationToken
+    //
+    // (i): Cooperative cancellation flag for long running bulk operations.
+    //
+    class ItsCancellationToken
+    {
+        private:
+        std::atomic<bool> m_bCancelled{false};
 
-            int i_flags = 0;
-            if (flags.find("r") != string::npos &&
-                flags.find("w") != string::npos)
-            {
-                i_flags |= O_RDWR;
-            }
-            else if (flags.find("r") != string::npos)
-            {
-                i_flags |= O_RDONLY;
-            }
-            else if (flags.find("w") != string::npos)
-            {
-                i_flags |= O_WRONLY;
-            }
-            else
-            {
-                return false;
-            }
+        protected:
+        public:
+        void Cancel()
+        {
+            this->m_bCancelled = true;
+        }
 
-            i_flags |= O_CREAT;
-            //i_flags |= O_LARGEFILE;
+        bool IsCancelled() const
+        {
+            return this->m_bCancelled;
+        }
 
-            if (flags.find("t") != string::npos)
-            {
-                i_flags |= O_TRUNC;
-            }
-            else if (flags.find("a") != string::npos)
-            {
-                i_flags |= O_APPEND;
-            }
+        void Reset()
+        {
+            this->m_bCancelled = false;
+        }
+    };
 
-            this->m_fd = open(filename.c_str(), i_flags, mode);
-            if (this->m_fd.IsInvalid())
+    //
+    // class: ItsRateLimiter
+    //
+    // (i): Token bucket limiting bytes/s and operations/s (IOPS), paced with ItsTimer.
+    //      A limit of 0 means unlimited. Limiters draw from the process wide budget
+    //      (GetProcess) as well, so that budget is shared by all in-flight jobs.
+    //      The bucket holds at most one second worth of tokens.
+    //
+    class ItsRateLimiter
+    {
+        private:
+        std::mutex m_mutex;
+        ItsTimer m_timer;
+        int64_t m_lastMicroseconds = 0;
+        double m_byteTokens = 0.0;
+        double m_operationTokens = 0.0;
+        std::atomic<uint64_t> m_bytesPerSecond{0};
+        std::atomic<uint64_t> m_operationsPerSecond{0};
+        ItsRateLimiter* m_parent = nullptr;
+
+        //
+        // (i) takes the tokens, possibly into debt, and returns how long to wait for the debt.
+        //
+        int64_t Reserve(uint64_t bytes, uint64_t operations)
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            uint64_t bytesPerSecond = this->m_bytesPerSecond;
+            uint64_t operationsPerSecond = this->m_operationsPerSecond;
+
+            int64_t now = this->m_timer.LapMicroseconds();
+            double elapsed = static_cast<double>(now - this->m_lastMicroseconds) / 1000000.0;
+            this->m_lastMicroseconds = now;
+
+            int64_t waitMicroseconds = 0;
+            if (bytesPerSecond > 0)
             {
-                return false;
+                this->m_byteTokens = std::min(static_cast<double>(bytesPerSecond), this->m_byteTokens + elapsed * static_cast<double>(bytesPerSecond));
+                this->m_byteTokens -= static_cast<double>(bytes);
+                if (this->m_byteTokens < 0)
+                {
+                    waitMicroseconds = static_cast<int64_t>(-this->m_byteTokens * 1000000.0 / static_cast<double>(bytesPerSecond));
+                }
             }
-            if (fchmod(this->m_fd, mode) != 0 )
+            if (operationsPerSecond > 0)
             {
-                this->Close();
-                return false;
+                this->m_operationTokens = std::min(static_cast<double>(operationsPerSecond), this->m_operationTokens + elapsed * static_cast<double>(operationsPerSecond));
+                this->m_operationTokens -= static_cast<double>(operations);
+                if (this->m_operationTokens < 0)
+                {
+                    waitMicroseconds = std::max(waitMicroseconds, static_cast<int64_t>(-this->m_operationTokens * 1000000.0 / static_cast<double>(operationsPerSecond)));
+                }
             }
+            return waitMicroseconds;
+        }
 
-            this->m_filename = filename;
+        explicit ItsRateLimiter(ItsRateLimiter* parent)
+            : m_parent(parent)
+        {
+            this->m_timer.Start();
+        }
 
-            return true;
+        protected:
+        public:
+        ItsRateLimiter(uint64_t bytesPerSecond, uint64_t operationsPerSecond)
+            : ItsRateLimiter(&ItsRateLimiter::GetProcess())
+        {
+            this->SetLimits(bytesPerSecond, operationsPerSecond);
         }
 
-        bool Write(const void *data, size_t bytesToWrite, size_t *bytesWritten)
+        ItsRateLimiter(const ItsRateLimiter&) = delete;
+        ItsRateLimiter& operator=(const ItsRateLimiter&) = delete;
+
+        void SetLimits(uint64_t bytesPerSecond, uint64_t operationsPerSecond)
         {
-            if (this->IsInvalid())
-            {
-                return false;
-            }
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_bytesPerSecond = bytesPerSecond;
+            this->m_operationsPerSecond = operationsPerSecond;
+            this->m_byteTokens = static_cast<double>(bytesPerSecond);
+            this->m_operationTokens = static_cast<double>(operationsPerSecond);
+        }
 
-            if (bytesToWrite == 0)
+        //
+        // Method: IsLimited
+        //
+        // (i) true if this limiter or the process budget has a limit.
+        //
+        bool IsLimited() const
+        {
+            if (this->m_bytesPerSecond > 0 || this->m_operationsPerSecond > 0)
             {
-                return false;
+                return true;
             }
-
-            *bytesWritten = write(this->m_fd.p(), data, bytesToWrite);
-
-            return (*bytesWritten > 0);
+            return (this->m_parent != nullptr && this->m_parent->IsLimited());
         }
 
-        bool Read(void *data, size_t bytesToRead, size_t *bytesRead)
+        //
+        // Method: Acquire
+        //
+        // (i) blocks until one operation of bytes may proceed. Returns false if cancel
+        //     is signalled while waiting.
+        //
+        bool Acquire(uint64_t bytes, const ItsCancellationToken* cancel = nullptr)
         {
-            if (this->IsInvalid())
+            if (this->m_bytesPerSecond > 0 || this->m_operationsPerSecond > 0)
             {
-                return false;
+                int64_t waitMicroseconds = this->Reserve(bytes, 1);
+                while (waitMicroseconds > 0)
+                {
+                    if (cancel != nullptr && cancel->IsCancelled())
+                    {
+                        return false;
+                    }
+                    int64_t slice = std::min<int64_t>(waitMicroseconds, 50000);
+                    std::this_thread::sleep_for(std::chrono::microseconds(slice));
+                    waitMicroseconds -= slice;
+                }
             }
 
-            if (bytesToRead == 0)
+            if (cancel != nullptr && cancel->IsCancelled())
             {
                 return false;
             }
 
-            *bytesRead = read(this->m_fd.p(), data, bytesToRead);
-
+            if (this->m_parent != nullptr)
+            {
+                return this->m_parent->Acquire(bytes, cancel);
+            }
             return true;
         }
 
         //
-        // ReadAllText
+        // Method: GetProcess
         //
-        bool ReadAllText(string& str)
+        // (i) process wide budget shared by every ItsRateLimiter and by bulk operations
+        //     given no limiter. Unlimited until SetLimits is called.
+        //
+        static ItsRateLimiter& GetProcess()
         {
-            if (this->IsInvalid())
-            {
-                return false;
-            }
+            static ItsRateLimiter s_process(nullptr);
+            return s_process;
+        }
+    };
 
-            this->SetPosFromBeg(0);
+    //
+    // enum: ItsFileIoOperation
+    //
+    // (i): asynchronous file operation type.
+    //
+    enum class ItsFileIoOperation
+    {
+        Read,
+        Write,
+        Fsync,
+        FullFsync
+    };
 
-            std::stringstream ss;
+    //
+    // struct: ItsFileIoRequest
+    //
+    // (i): positional asynchronous file operation. data must stay valid until completion.
+    //
+    struct ItsFileIoRequest
+    {
+        ItsFileIoOperation operation = ItsFileIoOperation::Read;
+        int fd = -1;
+        void* data = nullptr;
+        size_t length = 0;
+        off_t offset = 0;
+    };
 
-            char data[2048];
-            size_t bytesRead(0);
-            while (this->Read(reinterpret_cast<void*>(data), 2048, &bytesRead) && bytesRead > 0)
-            {
-                ss.write(data, bytesRead);
-            }
+    //
+    // struct: ItsFileIoResult
+    //
+    // (i): completion of an ItsFileIoRequest. error is an errno value, 0 on success.
+    //
+    struct ItsFileIoResult
+    {
+        ssize_t bytes = 0;
+        int error = 0;
+    };
 
-            str = ss.str();
-            return true;
+    //
+    // class: ItsFileAsyncIO
+    //
+    // (i): Asynchronous positional file I/O backed by a worker thread pool.
+    //      Completions are delivered through futures or callbacks (on a worker thread).
+    //
+    class ItsFileAsyncIO
+    {
+        private:
+        ItsThreadPool m_pool;
+
+        protected:
+        public:
+        explicit ItsFileAsyncIO(size_t threadCount = 4)
+            : m_pool(threadCount)
+        {
         }
 
         //
-        // ReadAllTextLines
+        // Method: Execute
         //
-        bool ReadAllTextLines(std::vector<string>& lines)
+        // (i) performs a request synchronously on the calling thread.
+        //
+        static ItsFileIoResult Execute(const ItsFileIoRequest& request)
         {
-            if (this->IsInvalid())
+            ItsFileIoResult result;
+            switch (request.operation)
             {
-                return false;
+                case ItsFileIoOperation::Read:
+                {
+                    ssize_t n;
+                    do
+                    {
+                        n = pread(request.fd, request.data, request.length, request.offset);
+                    } while (n < 0 && errno == EINTR);
+                    result.bytes = n;
+                    break;
+                }
+                case ItsFileIoOperation::Write:
+                {
+                    const uint8_t* p = static_cast<const uint8_t*>(request.data);
+                    size_t done = 0;
+                    while (done < request.length)
+                    {
+                        ssize_t n = pwrite(request.fd, p + done, request.length - done, request.offset + static_cast<off_t>(done));
+                        if (n < 0)
+                        {
+                            if (errno == EINTR)
+                            {
+                                continue;
+                            }
+                            break;
+                        }
+                        done += static_cast<size_t>(n);
+                    }
+                    result.bytes = (done == request.length) ? static_cast<ssize_t>(done) : -1;
+                    break;
+                }
+                case ItsFileIoOperation::Fsync:
+                    result.bytes = (fsync(request.fd) == 0) ? 0 : -1;
+                    break;
+                case ItsFileIoOperation::FullFsync:
+                    result.bytes = (fcntl(request.fd, F_FULLFSYNC) == 0) ? 0 : -1;
+                    break;
             }
 
-            this->SetPosFromBeg(0);
-
-            string str;
-            if (!this->ReadAllText(str))
+            if (result.bytes < 0)
             {
-                return false;
+                result.error = errno;
             }
+            return result;
+        }
 
-            string split("\n");
-            lines = ItsString::Split(str, split);
-            return true;
+        std::future<ItsFileIoResult> Submit(const ItsFileIoRequest& request)
+        {
+            return this->m_pool.Submit([request]() { return ItsFileAsyncIO::Execute(request); });
         }
 
-        bool SetPosFromBeg(off_t offset)
+        void Submit(const ItsFileIoRequest& request, function<void(const ItsFileIoResult&)> callback)
         {
-            if (this->IsInvalid())
-            {
-                return false;
-            }
+            this->m_pool.Enqueue([request, callback]() { callback(ItsFileAsyncIO::Execute(request)); });
+        }
 
-            if (lseek(this->m_fd, offset, SEEK_SET) == -1)
+        //
+        // Method: Submit
+        //
+        // (i) batched submission. All requests are queued at once and may complete in any order.
+        //
+        vector<std::future<ItsFileIoResult>> Submit(const vector<ItsFileIoRequest>& requests)
+        {
+            vector<std::future<ItsFileIoResult>> futures;
+            vector<function<void()>> work;
+            futures.reserve(requests.size());
+            work.reserve(requests.size());
+            for (const auto& request : requests)
             {
-                return false;
+                auto task = std::make_shared<std::packaged_task<ItsFileIoResult()>>([request]() { return ItsFileAsyncIO::Execute(request); });
+                futures.push_back(task->get_future());
+                work.push_back([task]() { (*task)(); });
             }
+            this->m_pool.EnqueueBatch(work);
+            return futures;
+        }
 
-            return true;
+        //
+        // Method: GetDefault
+        //
+        // (i) process wide instance used by ItsFile::ReadAsync/WriteAsync/FsyncAsync.
+        //
+        static ItsFileAsyncIO& GetDefault()
+        {
+            static ItsFileAsyncIO s_default;
+            return s_default;
         }
+    };
 
-        bool SetPosFromEnd(off_t offset)
+    //
+    // enum: ItsMetadataOperation
+    //
+    // (i): metadata operation type of ItsMetadataBatch.
+    //
+    enum class ItsMetadataOperation
+    {
+        Stat,
+        Unlink,
+        Rename,
+        CreateDirectory,
+        RemoveDirectory
+    };
+
+    //
+    // struct: ItsMetadataRequest
+    //
+    // (i): one metadata operation. path is relative to dirFd and targetPath, for Rename,
+    //      to targetDirFd; AT_FDCWD means relative to the working directory. mode is
+    //      used by CreateDirectory, followSymlinks by Stat.
+    //
+    struct ItsMetadataRequest
+    {
+        ItsMetadataOperation operation = ItsMetadataOperation::Stat;
+        int dirFd = AT_FDCWD;
+        string path;
+        int targetDirFd = AT_FDCWD;
+        string targetPath;
+        int mode = 0755;
+        bool followSymlinks = false;
+    };
+
+    //
+    // struct: ItsMetadataResult
+    //
+    // (i): completion of an ItsMetadataRequest. error is an errno value, 0 on success.
+    //      stat is filled in by Stat.
+    //
+    struct ItsMetadataResult
+    {
+        int error = 0;
+        struct stat stat = {};
+    };
+
+    //
+    // class: ItsMetadataBatch
+    //
+    // (i): Runs many stat, unlink, rename, mkdir and rmdir calls as one batch on a worker
+    //      thread pool. The batch is split into a few chunks per thread and queued with
+    //      a single EnqueueBatch, so queueing cost does not grow per operation.
+    //
+    class ItsMetadataBatch
+    {
+        private:
+        ItsThreadPool m_pool;
+
+        protected:
+        public:
+        explicit ItsMetadataBatch(size_t threadCount = 8)
+            : m_pool(threadCount)
         {
-            if (this->IsInvalid())
+        }
+
+        //
+        // Method: Execute
+        //
+        // (i) performs a request synchronously on the calling thread.
+        //
+        static ItsMetadataResult Execute(const ItsMetadataRequest& request)
+        {
+            ItsMetadataResult result;
+            int status = -1;
+            switch (request.operation)
             {
-                return false;
+                case ItsMetadataOperation::Stat:
+                    status = fstatat(request.dirFd, request.path.c_str(), &result.stat, request.followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW);
+                    break;
+                case ItsMetadataOperation::Unlink:
+                    status = unlinkat(request.dirFd, request.path.c_str(), 0);
+                    break;
+                case ItsMetadataOperation::Rename:
+                    status = renameat(request.dirFd, request.path.c_str(), request.targetDirFd, request.targetPath.c_str());
+                    break;
+                case ItsMetadataOperation::CreateDirectory:
+                    status = mkdirat(request.dirFd, request.path.c_str(), static_cast<mode_t>(request.mode));
+                    break;
+                case ItsMetadataOperation::RemoveDirectory:
+                    status = unlinkat(request.dirFd, request.path.c_str(), AT_REMOVEDIR);
+                    break;
             }
 
-            if (lseek(this->m_fd, offset, SEEK_END) == -1)
+            if (status != 0)
             {
-                return false;
+                result.error = errno;
             }
-
-            return true;
+            return result;
         }
 
-        bool SetPosFromCur(off_t offset)
+        //
+        // Method: ExecuteBatch
+        //
+        // (i) runs all requests and returns one result per request, in request order.
+        //     Requests are independent and run in any order; do not batch a rename
+        //     together with an operation that depends on it.
+        //
+        vector<ItsMetadataResult> ExecuteBatch(const vector<ItsMetadataRequest>& requests)
         {
-            if (this->IsInvalid())
+            vector<ItsMetadataResult> results(requests.size());
+            if (requests.empty())
             {
-                return false;
+                return results;
             }
 
-            if (lseek(this->m_fd, offset, SEEK_CUR) == -1)
+            size_t chunkCount = std::min(requests.size(), this->m_pool.GetThreadCount() * 4);
+            size_t chunkSize = (requests.size() + chunkCount - 1) / chunkCount;
+
+            vector<std::future<void>> futures;
+            vector<function<void()>> work;
+            for (size_t begin = 0; begin < requests.size(); begin += chunkSize)
             {
-                return false;
+                size_t end = std::min(requests.size(), begin + chunkSize);
+                auto task = std::make_shared<std::packaged_task<void()>>([&requests, &results, begin, end]() {
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        results[i] = ItsMetadataBatch::Execute(requests[i]);
+                    }
+                });
+                futures.push_back(task->get_future());
+                work.push_back([task]() { (*task)(); });
             }
+            this->m_pool.EnqueueBatch(work);
 
-            return true;
+            for (auto& future : futures)
+            {
+                future.wait();
+            }
+            return results;
         }
 
-        bool Close()
+        //
+        // Method: GetDefault
+        //
+        // (i) process wide instance.
+        //
+        static ItsMetadataBatch& GetDefault()
         {
-            return this->m_fd.Close();
+            static ItsMetadataBatch s_default;
+            return s_default;
         }
+    };
 
-        bool IsValid()
-        {
-            return this->m_fd.IsValid();
-        }
+    //
+    // enum: ItsHashAlgorithm
+    //
+    // (i): non-cryptographic checksum/hash algorithms of ItsHasher.
+    //
+    enum class ItsHashAlgorithm
+    {
+        Crc32c,
+        XxHash64
+    };
 
-        bool IsInvalid()
+    //
+    // class: ItsHasher
+    //
+    // (i): Streaming CRC32C (SSE4.2 / ARMv8 CRC instructions when available) and XXH64.
+    //      Feed data with Update, read the digest with GetDigest.
+    //
+    class ItsHasher
+    {
+        private:
+        ItsHashAlgorithm m_algorithm;
+        uint64_t m_seed;
+        uint32_t m_crc = 0;
+        uint64_t m_acc[4] = {0, 0, 0, 0};
+        uint8_t m_pending[32];
+        size_t m_pendingSize = 0;
+        uint64_t m_totalLength = 0;
+
+        static constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+        static constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+        static constexpr uint64_t Prime3 = 0x165667B19E3779F9ull;
+        static constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+        static constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+        static uint64_t Rotl64(uint64_t v, int r)
         {
-            return this->m_fd.IsInvalid();
+            return (v << r) | (v >> (64 - r));
         }
 
-        operator int()
+        static uint64_t Read64(const uint8_t* p)
         {
-            return this->m_fd.p();
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
         }
 
-        //
-        // GetFileSize
-        //
-        static size_t GetFileSize(string filename)
+        static uint32_t Read32(const uint8_t* p)
         {
-            struct stat statbuf;
-            if ( stat(filename.c_str(), &statbuf) == -1 ) {
-                return -1;
-            }
-            return statbuf.st_size;
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
         }
 
-        static bool Delete(string filename)
+        static uint64_t XxRound(uint64_t acc, uint64_t input)
         {
-            return (!unlink(filename.c_str()));
+            acc += input * Prime2;
+            acc = Rotl64(acc, 31);
+            return acc * Prime1;
         }
 
-        static bool Exists(string filename)
+        static uint64_t XxMerge(uint64_t acc, uint64_t v)
         {
-            struct stat sb;
-            if(stat(filename.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
-                return true;
-            }
-            return false;
+            acc ^= XxRound(0, v);
+            return acc * Prime1 + Prime4;
         }
 
-        static bool Move(string sourceFilename, string targetFilename)
+        void XxConsume(const uint8_t* p)
         {
-            return (!rename(sourceFilename.c_str(), targetFilename.c_str()));
+            this->m_acc[0] = XxRound(this->m_acc[0], Read64(p));
+            this->m_acc[1] = XxRound(this->m_acc[1], Read64(p + 8));
+            this->m_acc[2] = XxRound(this->m_acc[2], Read64(p + 16));
+            this->m_acc[3] = XxRound(this->m_acc[3], Read64(p + 24));
         }
 
-        static bool Copy(string sourceFilename, string targetFilename, bool replaceIfExists)
+        void XxUpdate(const uint8_t* p, size_t length)
         {
-            if (!ItsFile::Exists(sourceFilename))
+            this->m_totalLength += length;
+
+            if (this->m_pendingSize + length < 32)
             {
-                return false;
+                memcpy(this->m_pending + this->m_pendingSize, p, length);
+                this->m_pendingSize += length;
+                return;
             }
 
-            ItsFile source;
-            source.OpenExisting(sourceFilename, "r");
-            if (source.IsInvalid())
+            if (this->m_pendingSize > 0)
             {
-                return false;
+                size_t fill = 32 - this->m_pendingSize;
+                memcpy(this->m_pending + this->m_pendingSize, p, fill);
+                this->XxConsume(this->m_pending);
+                p += fill;
+                length -= fill;
+                this->m_pendingSize = 0;
             }
 
-            if (ItsFile::Exists(targetFilename) && !replaceIfExists)
+            while (length >= 32)
             {
-                return false;
+                this->XxConsume(p);
+                p += 32;
+                length -= 32;
             }
 
-            ItsFile target;
-            if (ItsFile::Exists(targetFilename))
+            memcpy(this->m_pending, p, length);
+            this->m_pendingSize = length;
+        }
+
+        uint64_t XxDigest() const
+        {
+            uint64_t h;
+            if (this->m_totalLength >= 32)
             {
-                target.OpenExisting(targetFilename, "w");
+                h = Rotl64(this->m_acc[0], 1) + Rotl64(this->m_acc[1], 7) + Rotl64(this->m_acc[2], 12) + Rotl64(this->m_acc[3], 18);
+                h = XxMerge(h, this->m_acc[0]);
+                h = XxMerge(h, this->m_acc[1]);
+                h = XxMerge(h, this->m_acc[2]);
+                h = XxMerge(h, this->m_acc[3]);
             }
             else
             {
-                int mode = 0;
-                ItsFile::GetMode(sourceFilename, &mode);
-                target.OpenOrCreate(targetFilename, "wt", mode);
+                h = this->m_seed + Prime5;
             }
+            h += this->m_totalLength;
 
-            if (target.IsInvalid())
+            const uint8_t* p = this->m_pending;
+            size_t length = this->m_pendingSize;
+            while (length >= 8)
             {
-                return false;
+                h ^= XxRound(0, Read64(p));
+                h = Rotl64(h, 27) * Prime1 + Prime4;
+                p += 8;
+                length -= 8;
             }
-
-            const int buff_size = 8192;
-            unique_ptr<uint8_t[]> buffer = make_unique<uint8_t[]>(buff_size);
-            size_t bytes_read{0};
-            size_t bytes_written{0};
-            while (source.Read(buffer.get(), buff_size, &bytes_read) && bytes_read > 0)
+            if (length >= 4)
+            {
+                h ^= static_cast<uint64_t>(Read32(p)) * Prime1;
+                h = Rotl64(h, 23) * Prime2 + Prime3;
+                p += 4;
+                length -= 4;
+            }
+            while (length > 0)
             {
-                target.Write(buffer.get(), bytes_read, &bytes_written);
+                h ^= static_cast<uint64_t>(*p) * Prime5;
+                h = Rotl64(h, 11) * Prime1;
+                p++;
+                length--;
             }
 
-            return true;
+            h ^= h >> 33;
+            h *= Prime2;
+            h ^= h >> 29;
+            h *= Prime3;
+            h ^= h >> 32;
+            return h;
         }
 
-        static bool GetMode(string filename, int *mode)
+        static uint32_t Crc32cSoftware(uint32_t crc, const uint8_t* p, size_t length)
         {
-            if (!ItsFile::Exists(filename))
+            static const vector<uint32_t> s_table = []() {
+                vector<uint32_t> table(256);
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++)
+                    {
+                        c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : (c >> 1);
+                    }
+                    table[i] = c;
+                }
+                return table;
+            }();
+
+            while (length-- > 0)
             {
-                return false;
+                crc = s_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
             }
+            return crc;
+        }
 
-            struct stat stat1;
-            if (stat(filename.c_str(), &stat1) != 0)
+#if defined(__x86_64__)
+        __attribute__((target("sse4.2")))
+        static uint32_t Crc32cHardware(uint32_t crc, const uint8_t* p, size_t length)
+        {
+            uint64_t c = crc;
+            while (length >= 8)
             {
-                return false;
+                c = _mm_crc32_u64(c, Read64(p));
+                p += 8;
+                length -= 8;
             }
-            *mode = stat1.st_mode;
+            uint32_t c32 = static_cast<uint32_t>(c);
+            while (length-- > 0)
+            {
+                c32 = _mm_crc32_u8(c32, *p++);
+            }
+            return c32;
+        }
+
+        static bool HasHardwareCrc32c()
+        {
+            static const bool s_supported = __builtin_cpu_supports("sse4.2");
+            return s_supported;
+        }
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+        static uint32_t Crc32cHardware(uint32_t crc, const uint8_t* p, size_t length)
+        {
+            while (length >= 8)
+            {
+                crc = __crc32cd(crc, Read64(p));
+                p += 8;
+                length -= 8;
+            }
+            while (length-- > 0)
+            {
+                crc = __crc32cb(crc, *p++);
+            }
+            return crc;
+        }
+
+        static bool HasHardwareCrc32c()
+        {
             return true;
         }
+#else
+        static uint32_t Crc32cHardware(uint32_t crc, const uint8_t* p, size_t length)
+        {
+            return ItsHasher::Crc32cSoftware(crc, p, length);
+        }
+
+        static bool HasHardwareCrc32c()
+        {
+            return false;
+        }
+#endif
+
+        protected:
+        public:
+        explicit ItsHasher(ItsHashAlgorithm algorithm, uint64_t seed = 0)
+            : m_algorithm(algorithm),
+              m_seed(seed)
+        {
+            this->Reset();
+        }
+
+        void Reset()
+        {
+            this->m_crc = ~static_cast<uint32_t>(this->m_seed);
+            this->m_acc[0] = this->m_seed + Prime1 + Prime2;
+            this->m_acc[1] = this->m_seed + Prime2;
+            this->m_acc[2] = this->m_seed;
+            this->m_acc[3] = this->m_seed - Prime1;
+            this->m_pendingSize = 0;
+            this->m_totalLength = 0;
+        }
+
+        void Update(const void *data, size_t length)
+        {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            if (this->m_algorithm == ItsHashAlgorithm::Crc32c)
+            {
+                this->m_crc = ItsHasher::HasHardwareCrc32c() ? ItsHasher::Crc32cHardware(this->m_crc, p, length) : ItsHasher::Crc32cSoftware(this->m_crc, p, length);
+                this->m_totalLength += length;
+            }
+            else
+            {
+                this->XxUpdate(p, length);
+            }
+        }
+
+        //
+        // Method: GetDigest
+        //
+        // (i) digest of the data so far. CRC32C digests use the low 32 bits.
+        //
+        uint64_t GetDigest() const
+        {
+            if (this->m_algorithm == ItsHashAlgorithm::Crc32c)
+            {
+                return static_cast<uint64_t>(~this->m_crc);
+            }
+            return this->XxDigest();
+        }
+
+        ItsHashAlgorithm GetAlgorithm() const
+        {
+            return this->m_algorithm;
+        }
+
+        static uint64_t Compute(ItsHashAlgorithm algorithm, const void *data, size_t length, uint64_t seed = 0)
+        {
+            ItsHasher hasher(algorithm, seed);
+            hasher.Update(data, length);
+            return hasher.GetDigest();
+        }
+    };
+
+    //
+    // struct: ItsFileHashResult
+    //
+    // (i): digest of one file from ItsFile::HashFiles.
+    //
+    struct ItsFileHashResult
+    {
+        string filename;
+        bool success = false;
+        uint64_t digest = 0;
+    };
+
+    //
+    // enum: ItsFileCopyStrategy
+    //
+    // (i): strategy ItsFile::Copy used to move the data.
+    //
+    enum class ItsFileCopyStrategy
+    {
+        None,
+        Clone,
+        CopyFile,
+        ReadWrite,
+        Sparse,
+        Delta,
+        Chunked
+    };
+
+    //
+    // struct: ItsFileCopyOptions
+    //
+    // (i): options for ItsFile::Copy. Without a rateLimiter the copy is paced by
+    //      ItsRateLimiter::GetProcess(). progress is called after each chunk.
+    //
+    struct ItsFileCopyOptions
+    {
+        bool replaceIfExists = false;
+        bool allowClone = true;
+        bool allowCopyFile = true;
+        bool preserveSparse = false;
+        bool verify = false;
+        ItsHashAlgorithm hashAlgorithm = ItsHashAlgorithm::Crc32c;
+        bool delta = false;
+        size_t deltaBlockSize = 128 * 1024;
+        size_t bufferSize = 1024 * 1024;
+        ItsRateLimiter* rateLimiter = nullptr;
+        ItsCancellationToken* cancel = nullptr;
+        function<void(uint64_t bytesDone, uint64_t bytesTotal)> progress;
+    };
+
+    //
+    // struct: ItsFileCopyResult
+    //
+    // (i): outcome of ItsFile::Copy.
+    //
+    struct ItsFileCopyResult
+    {
+        ItsFileCopyStrategy strategy = ItsFileCopyStrategy::None;
+        uint64_t bytesCopied = 0;
+        uint64_t bytesSkipped = 0;
+        uint64_t digest = 0;
+        bool verified = false;
+    };
+
+    //
+    // class: ItsAlignedBufferPool
+    //
+    // (i): Pool of equally sized buffers aligned to a device block size, for uncached
+    //      (F_NOCACHE) I/O. Buffers are handed out through ItsAlignedBuffer.
+    //
+    class ItsAlignedBufferPool
+    {
+        private:
+        size_t m_bufferSize;
+        size_t m_alignment;
+        vector<uint8_t*> m_free;
+        std::mutex m_mutex;
+
+        protected:
+        public:
+        //
+        // (i) bufferSize is rounded up to a multiple of alignment. alignment must be a power of two.
+        //
+        ItsAlignedBufferPool(size_t bufferSize, size_t alignment)
+        {
+            this->m_alignment = std::max<size_t>(alignment, sizeof(void*));
+            this->m_bufferSize = ((std::max<size_t>(bufferSize, 1) + this->m_alignment - 1) / this->m_alignment) * this->m_alignment;
+        }
+
+        ItsAlignedBufferPool(const ItsAlignedBufferPool&) = delete;
+        ItsAlignedBufferPool& operator=(const ItsAlignedBufferPool&) = delete;
+
+        //
+        // (i) all buffers must have been returned.
+        //
+        ~ItsAlignedBufferPool()
+        {
+            for (auto p : this->m_free)
+            {
+                free(p);
+            }
+        }
+
+        //
+        // Method: Rent
+        //
+        // (i) returns a free buffer, allocating when the pool is empty. nullptr on failure.
+        //
+        uint8_t* Rent()
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                if (this->m_free.size() > 0)
+                {
+                    uint8_t* p = this->m_free.back();
+                    this->m_free.pop_back();
+                    return p;
+                }
+            }
+
+            void* p = nullptr;
+            if (posix_memalign(&p, this->m_alignment, this->m_bufferSize) != 0)
+            {
+                return nullptr;
+            }
+            return static_cast<uint8_t*>(p);
+        }
+
+        void Return(uint8_t* buffer)
+        {
+            if (buffer == nullptr)
+            {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_free.push_back(buffer);
+        }
+
+        size_t GetBufferSize() const
+        {
+            return this->m_bufferSize;
+        }
+
+        size_t GetAlignment() const
+        {
+            return this->m_alignment;
+        }
+    };
+
+    //
+    // class: ItsAlignedBuffer
+    //
+    // (i): Buffer rented from an ItsAlignedBufferPool, returned when destroyed.
+    //
+    class ItsAlignedBuffer
+    {
+        private:
+        ItsAlignedBufferPool* m_pool = nullptr;
+        uint8_t* m_data = nullptr;
+
+        protected:
+        public:
+        explicit ItsAlignedBuffer(ItsAlignedBufferPool& pool)
+            : m_pool(&pool),
+              m_data(pool.Rent())
+        {
+        }
+
+        ItsAlignedBuffer(const ItsAlignedBuffer&) = delete;
+        ItsAlignedBuffer& operator=(const ItsAlignedBuffer&) = delete;
+
+        ItsAlignedBuffer(ItsAlignedBuffer&& other)
+            : m_pool(other.m_pool),
+              m_data(other.m_data)
+        {
+            other.m_data = nullptr;
+        }
+
+        ~ItsAlignedBuffer()
+        {
+            this->m_pool->Return(this->m_data);
+        }
+
+        uint8_t* GetData()
+        {
+            return this->m_data;
+        }
+
+        size_t GetSize() const
+        {
+            return this->m_pool->GetBufferSize();
+        }
+
+        bool IsValid() const
+        {
+            return (this->m_data != nullptr);
+        }
+    };
+
+    //
+    // enum: ItsFileAccessHint
+    //
+    // (i): access pattern hint for ItsFile::Advise.
+    //
+    enum class ItsFileAccessHint
+    {
+        Normal,
+        Sequential,
+        Random,
+        WillNeed,
+        DontNeed
+    };
+
+    //
+    // struct: ItsFileResumableCopyOptions
+    //
+    // (i): options for ItsFile::CopyResumable. progress is called from the worker threads,
+    //      one call at a time.
+    //
+    struct ItsFileResumableCopyOptions
+    {
+        bool replaceIfExists = false;
+        size_t chunkSize = 8 * 1024 * 1024;
+        size_t threadCount = 4;
+        bool verifyOnResume = true;
+        bool durable = false;
+        ItsRateLimiter* rateLimiter = nullptr;
+        ItsCancellationToken* cancel = nullptr;
+        function<void(uint64_t bytesDone, uint64_t bytesTotal)> progress;
+    };
+
+    //
+    // enum: ItsShredPattern
+    //
+    // (i): data written by one ItsFile::Shred pass.
+    //
+    enum class ItsShredPattern
+    {
+        Zeros,
+        Ones,
+        Random
+    };
+
+    //
+    // struct: ItsShredOptions
+    //
+    // (i): options for ItsFile::Shred. noCache sets F_NOCACHE (the macOS counterpart of O_DIRECT).
+    //      progress reports bytes over all passes.
+    //
+    struct ItsShredOptions
+    {
+        vector<ItsShredPattern> passes{ ItsShredPattern::Ones };
+        size_t bufferSize = 1024 * 1024;
+        bool noCache = false;
+        bool syncBetweenPasses = true;
+        bool punchHole = false;
+        bool alsoDelete = false;
+        ItsRateLimiter* rateLimiter = nullptr;
+        ItsCancellationToken* cancel = nullptr;
+        function<void(uint64_t bytesDone, uint64_t bytesTotal)> progress;
+    };
+
+    //
+    // struct: ItsShredPassResult
+    //
+    // (i): throughput of one shred pass.
+    //
+    struct ItsShredPassResult
+    {
+        ItsShredPattern pattern = ItsShredPattern::Ones;
+        uint64_t bytesWritten = 0;
+        int64_t microseconds = 0;
+
+        double GetMegabytesPerSecond() const
+        {
+            return (this->microseconds > 0) ? static_cast<double>(this->bytesWritten) / static_cast<double>(this->microseconds) : 0.0;
+        }
+    };
+
+    //
+    // struct: ItsShredResult
+    //
+    // (i): outcome of shredding one file.
+    //
+    struct ItsShredResult
+    {
+        string filename;
+        bool success = false;
+        int error = 0;
+        vector<ItsShredPassResult> passes;
+    };
+
+    //
+    // File IO Wrapper
+    //
+    class ItsFile
+    {
+        private:
+        unique_file_handle m_fd;
+        string m_filename;
+
+        //
+        // Method: CopyClone
+        //
+        // (i) clones source into targetFilename. An existing target is replaced through a
+        //     temporary clone renamed into place, as clonefile refuses existing names.
+        //
+        static bool CopyClone(int sourceFd, string targetFilename, bool targetExists)
+        {
+            if (!targetExists)
+            {
+                return (fclonefileat(sourceFd, AT_FDCWD, targetFilename.c_str(), 0) == 0);
+            }
+
+            string tempFilename = targetFilename + "." + ItsGuid::CreateGuid() + ".tmp";
+            if (fclonefileat(sourceFd, AT_FDCWD, tempFilename.c_str(), 0) != 0)
+            {
+                return false;
+            }
+
+            if (rename(tempFilename.c_str(), targetFilename.c_str()) != 0)
+            {
+                unlink(tempFilename.c_str());
+                return false;
+            }
+
+            return true;
+        }
+
+        //
+        // Method: Throttle
+        //
+        // (i) paces a bulk operation through rateLimiter (the process budget when nullptr).
+        //     Returns false with errno = ECANCELED when cancel is signalled.
+        //
+        static bool Throttle(ItsRateLimiter* rateLimiter, const ItsCancellationToken* cancel, uint64_t bytes)
+        {
+            ItsRateLimiter& limiter = (rateLimiter != nullptr) ? *rateLimiter : ItsRateLimiter::GetProcess();
+            if ((cancel != nullptr && cancel->IsCancelled()) || !limiter.Acquire(bytes, cancel))
+            {
+                errno = ECANCELED;
+                return false;
+            }
+            return true;
+        }
+
+        //
+        // Method: IsControlled
+        //
+        // (i) true when a copy must stay in user space to be paced, cancelled or reported on.
+        //
+        static bool IsControlled(const ItsFileCopyOptions& options)
+        {
+            ItsRateLimiter& limiter = (options.rateLimiter != nullptr) ? *options.rateLimiter : ItsRateLimiter::GetProcess();
+            return (limiter.IsLimited() || options.cancel != nullptr || options.progress);
+        }
+
+        //
+        // Method: CopySparse
+        //
+        // (i) copies only the data extents found by SEEK_DATA/SEEK_HOLE and recreates the
+        //     holes by truncating the target to size. Returns 1 on success, 0 if the file
+        //     system does not report extents (nothing written) and -1 on error.
+        //
+        static int CopySparse(int sourceFd, int targetFd, off_t size, uint8_t* buffer, size_t bufferSize, const ItsFileCopyOptions& options, uint64_t* dataCopied)
+        {
+            *dataCopied = 0;
+            off_t offset = 0;
+            while (offset < size)
+            {
+                off_t dataStart = lseek(sourceFd, offset, SEEK_DATA);
+                if (dataStart == -1)
+                {
+                    if (errno == ENXIO)
+                    {
+                        break;
+                    }
+                    return (offset == 0 && (errno == EINVAL || errno == ENOTSUP)) ? 0 : -1;
+                }
+
+                off_t dataEnd = lseek(sourceFd, dataStart, SEEK_HOLE);
+                if (dataEnd == -1 || dataEnd > size)
+                {
+                    dataEnd = size;
+                }
+
+                while (dataStart < dataEnd)
+                {
+                    size_t toRead = static_cast<size_t>(std::min<off_t>(dataEnd - dataStart, static_cast<off_t>(bufferSize)));
+                    ssize_t bytesRead = pread(sourceFd, buffer, toRead, dataStart);
+                    if (bytesRead < 0)
+                    {
+                        if (errno == EINTR)
+                        {
+                            continue;
+                        }
+                        return -1;
+                    }
+                    if (bytesRead == 0)
+                    {
+                        break;
+                    }
+                    if (!ItsFile::Throttle(options.rateLimiter, options.cancel, static_cast<uint64_t>(bytesRead)))
+                    {
+                        return -1;
+                    }
+
+                    size_t done = 0;
+                    while (done < static_cast<size_t>(bytesRead))
+                    {
+                        ssize_t written = pwrite(targetFd, buffer + done, static_cast<size_t>(bytesRead) - done, dataStart + static_cast<off_t>(done));
+                        if (written < 0)
+                        {
+                            if (errno == EINTR)
+                            {
+                                continue;
+                            }
+                            return -1;
+                        }
+                        done += static_cast<size_t>(written);
+                    }
+
+                    dataStart += bytesRead;
+                    *dataCopied += static_cast<uint64_t>(bytesRead);
+                    if (options.progress)
+                    {
+                        options.progress(static_cast<uint64_t>(dataStart), static_cast<uint64_t>(size));
+                    }
+                }
+
+                offset = dataEnd;
+            }
+
+            return (ftruncate(targetFd, size) == 0) ? 1 : -1;
+        }
+
+        //
+        // Method: TransferV
+        //
+        // (i) vectored read or write. offset < 0 uses the file position (readv/writev),
+        //     otherwise preadv/pwritev. Writes are completed across short writes, reads
+        //     stop at the first short read. Batches of more than IOV_MAX buffers are split.
+        //
+        static bool TransferV(int fd, vector<struct iovec> buffers, off_t offset, bool isWrite, size_t *bytesTransferred)
+        {
+            *bytesTransferred = 0;
+            size_t index = 0;
+            while (index < buffers.size())
+            {
+                if (buffers[index].iov_len == 0)
+                {
+                    index++;
+                    continue;
+                }
+
+                int count = static_cast<int>(std::min<size_t>(buffers.size() - index, IOV_MAX));
+                size_t requested = 0;
+                for (int i = 0; i < count; i++)
+                {
+                    requested += buffers[index + i].iov_len;
+                }
+
+                ssize_t n;
+                if (isWrite)
+                {
+                    n = (offset < 0) ? writev(fd, &buffers[index], count) : pwritev(fd, &buffers[index], count, offset);
+                }
+                else
+                {
+                    n = (offset < 0) ? readv(fd, &buffers[index], count) : preadv(fd, &buffers[index], count, offset);
+                }
+
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+
+                *bytesTransferred += static_cast<size_t>(n);
+                if (offset >= 0)
+                {
+                    offset += n;
+                }
+
+                if (!isWrite && static_cast<size_t>(n) < requested)
+                {
+                    return true;
+                }
+
+                // skip completed buffers and advance into a partially written one
+                size_t remaining = static_cast<size_t>(n);
+                while (remaining > 0 && remaining >= buffers[index].iov_len)
+                {
+                    remaining -= buffers[index].iov_len;
+                    index++;
+                }
+                if (remaining > 0)
+                {
+                    buffers[index].iov_base = static_cast<uint8_t*>(buffers[index].iov_base) + remaining;
+                    buffers[index].iov_len -= remaining;
+                }
+            }
+            return true;
+        }
+
+        //
+        // Method: FillRandom
+        //
+        // (i) fills data from a xorshift64* generator. Not cryptographic, only fast.
+        //
+        static void FillRandom(uint8_t* data, size_t length, uint64_t& state)
+        {
+            if (state == 0)
+            {
+                state = 0x9E3779B97F4A7C15ull;
+            }
+
+            size_t i = 0;
+            for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+            {
+                state ^= state >> 12;
+                state ^= state << 25;
+                state ^= state >> 27;
+                uint64_t v = state * 0x2545F4914F6CDD1Dull;
+                memcpy(data + i, &v, sizeof(v));
+            }
+            for (; i < length; i++)
+            {
+                state ^= state >> 12;
+                state ^= state << 25;
+                state ^= state >> 27;
+                data[i] = static_cast<uint8_t>((state * 0x2545F4914F6CDD1Dull) >> 56);
+            }
+        }
+
+        //
+        // Method: CopyDelta
+        //
+        // (i) updates an existing target in place. Source and target blocks at the same
+        //     offset are compared byte for byte and only blocks that differ are rewritten.
+        //     The target is finally truncated to the source size.
+        //
+        static bool CopyDelta(int sourceFd, string targetFilename, const struct stat& sourceStat, const ItsFileCopyOptions& options, ItsFileCopyResult* result)
+        {
+            unique_file_handle target(open(targetFilename.c_str(), O_RDWR));
+            if (target.IsInvalid())
+            {
+                return false;
+            }
+
+            struct stat targetStat;
+            if (fstat(target.p(), &targetStat) != 0)
+            {
+                return false;
+            }
+
+            size_t blockSize = (options.deltaBlockSize > 0) ? options.deltaBlockSize : 128 * 1024;
+            unique_ptr<uint8_t[]> sourceBlock = make_unique<uint8_t[]>(blockSize);
+            unique_ptr<uint8_t[]> targetBlock = make_unique<uint8_t[]>(blockSize);
+            fcntl(sourceFd, F_RDAHEAD, 1);
+            fcntl(target.p(), F_RDAHEAD, 1);
+
+            uint64_t bytesWritten{0};
+            uint64_t bytesSkipped{0};
+            off_t offset = 0;
+            while (offset < sourceStat.st_size)
+            {
+                size_t length = static_cast<size_t>(std::min<off_t>(sourceStat.st_size - offset, static_cast<off_t>(blockSize)));
+                if (!ItsFile::Throttle(options.rateLimiter, options.cancel, length))
+                {
+                    return false;
+                }
+
+                size_t sourceRead = 0;
+                if (!ItsFile::ReadFullyAt(sourceFd, sourceBlock.get(), length, offset, &sourceRead) || sourceRead != length)
+                {
+                    return false;
+                }
+
+                bool same = false;
+                if (offset + static_cast<off_t>(length) <= targetStat.st_size)
+                {
+                    size_t targetRead = 0;
+                    if (!ItsFile::ReadFullyAt(target.p(), targetBlock.get(), length, offset, &targetRead))
+                    {
+                        return false;
+                    }
+                    same = (targetRead == length && memcmp(sourceBlock.get(), targetBlock.get(), length) == 0);
+                }
+
+                if (same)
+                {
+                    bytesSkipped += length;
+                }
+                else
+                {
+                    struct iovec iov;
+                    iov.iov_base = sourceBlock.get();
+                    iov.iov_len = length;
+                    size_t written = 0;
+                    if (!ItsFile::TransferV(target.p(), vector<struct iovec>{iov}, offset, true, &written))
+                    {
+                        return false;
+                    }
+                    bytesWritten += length;
+                }
+                offset += static_cast<off_t>(length);
+
+                if (options.progress)
+                {
+                    options.progress(static_cast<uint64_t>(offset), static_cast<uint64_t>(sourceStat.st_size));
+                }
+            }
+
+            if (targetStat.st_size != sourceStat.st_size && ftruncate(target.p(), sourceStat.st_size) != 0)
+            {
+                return false;
+            }
+
+            if (result != nullptr)
+            {
+                result->strategy = ItsFileCopyStrategy::Delta;
+                result->bytesCopied = bytesWritten;
+                result->bytesSkipped = bytesSkipped;
+            }
+            return true;
+        }
+
+        //
+        // Method: ReadFullyAt
+        //
+        // (i) pread that retries short reads until length bytes or end of file.
+        //
+        static bool ReadFullyAt(int fd, uint8_t* data, size_t length, off_t offset, size_t* bytesRead)
+        {
+            *bytesRead = 0;
+            while (*bytesRead < length)
+            {
+                ssize_t n = pread(fd, data + *bytesRead, length - *bytesRead, offset + static_cast<off_t>(*bytesRead));
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                if (n == 0)
+                {
+                    break;
+                }
+                *bytesRead += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        //
+        // Method: TeeBuffered
+        //
+        // (i) read/write pump behind Splice and Tee. secondTargetFd < 0 writes to targetFd only.
+        //
+        static bool TeeBuffered(int sourceFd, int targetFd, int secondTargetFd, size_t bytes, size_t *bytesTransferred)
+        {
+            const size_t bufferSize = 256 * 1024;
+            unique_ptr<uint8_t[]> buffer = make_unique<uint8_t[]>(bufferSize);
+            while (bytes == 0 || *bytesTransferred < bytes)
+            {
+                size_t toRead = (bytes == 0) ? bufferSize : std::min(bufferSize, bytes - *bytesTransferred);
+                ssize_t bytesRead = read(sourceFd, buffer.get(), toRead);
+                if (bytesRead < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                if (bytesRead == 0)
+                {
+                    break;
+                }
+
+                if (!ItsFile::WriteAll(targetFd, buffer.get(), static_cast<size_t>(bytesRead)) ||
+                    (secondTargetFd >= 0 && !ItsFile::WriteAll(secondTargetFd, buffer.get(), static_cast<size_t>(bytesRead))))
+                {
+                    return false;
+                }
+                *bytesTransferred += static_cast<size_t>(bytesRead);
+            }
+            return true;
+        }
+
+        ItsFileIoRequest CreateIoRequest(ItsFileIoOperation operation, void *data, size_t length, off_t offset)
+        {
+            ItsFileIoRequest request;
+            request.operation = operation;
+            request.fd = this->m_fd.p();
+            request.data = data;
+            request.length = length;
+            request.offset = offset;
+            return request;
+        }
+
+        protected:
+        public:
+        ItsFile()
+        {
+        }
+
+        //
+        // GetFilename
+        //
+        string GetFilename()
+        {
+                return this->m_filename;
+        }
+
+        //
+        // Method: OpenExisting
+        //
+        bool OpenExisting(string filename, string flags)
+        {
+            return this->OpenExistingAt(AT_FDCWD, filename, flags);
+        }
+
+        //
+        // Method: OpenExistingAt
+        //
+        // (i) as OpenExisting, with filename relative to the open directory dirFd.
+        //
+        bool OpenExistingAt(int dirFd, string filename, string flags)
+        {
+            if (this->m_fd.IsValid())
+            {
+                return false;
+            }
+
+            if (filename.size() == 0)
+            {
+                return false;
+            }
+
+            if (flags.size() == 0)
+            {
+                return false;
+            }
+
+            struct stat sb;
+            if (fstatat(dirFd, filename.c_str(), &sb, 0) != 0 || !S_ISREG(sb.st_mode))
+            {
+                return false;
+            }
+
+            int i_flags = 0;
+            if (flags.find("r") != string::npos &&
+                flags.find("w") != string::npos)
+            {
+                i_flags |= O_RDWR;
+            }
+            else if (flags.find("r") != string::npos)
+            {
+                i_flags |= O_RDONLY;
+            }
+            else if (flags.find("w") != string::npos)
+            {
+                i_flags |= O_WRONLY;
+            }
+            else
+            {
+                return false;
+            }
+
+            i_flags |= O_CREAT;
+            //i_flags |= O_LARGEFILE;
+
+            if (flags.find("t") != string::npos)
+            {
+                i_flags |= O_TRUNC;
+            }
+            else if (flags.find("a") != string::npos)
+            {
+                i_flags |= O_APPEND;
+            }
+
+            this->m_fd = openat(dirFd, filename.c_str(), i_flags);
+            if (this->m_fd.IsInvalid())
+            {
+                return false;
+            }
+
+            if (flags.find("d") != string::npos && !this->SetNoCache(true))
+            {
+                this->Close();
+                return false;
+            }
+
+            this->m_filename = filename;
+            return true;
+        }
+
+        //
+        // Method: OpenOrCreate
+        //
+        // (i) mode = "rwtad" (read, write, trunc, append, direct/uncached)
+        //
+        bool OpenOrCreate(string filename, string flags, int mode)
+        {
+            return this->OpenOrCreateAt(AT_FDCWD, filename, flags, mode);
+        }
+
+        //
+        // Method: OpenOrCreateAt
+        //
+        // (i) as OpenOrCreate, with filename relative to the open directory dirFd.
+        //
+        bool OpenOrCreateAt(int dirFd, string filename, string flags, int mode)
+        {
+            if (this->m_fd.IsValid())
+            {
+                return false;
+            }
+
+            if (filename.size() == 0)
+            {
+                return false;
+            }
+
+            if (flags.size() == 0)
+            {
+                return false;
+            }
+
+            int i_flags = 0;
+            if (flags.find("r") != string::npos &&
+                flags.find("w") != string::npos)
+            {
+                i_flags |= O_RDWR;
+            }
+            else if (flags.find("r") != string::npos)
+            {
+                i_flags |= O_RDONLY;
+            }
+            else if (flags.find("w") != string::npos)
+            {
+                i_flags |= O_WRONLY;
+            }
+            else
+            {
+                return false;
+            }
+
+            i_flags |= O_CREAT;
+            //i_flags |= O_LARGEFILE;
+
+            if (flags.find("t") != string::npos)
+            {
+                i_flags |= O_TRUNC;
+            }
+            else if (flags.find("a") != string::npos)
+            {
+                i_flags |= O_APPEND;
+            }
+
+            this->m_fd = openat(dirFd, filename.c_str(), i_flags, mode);
+            if (this->m_fd.IsInvalid())
+            {
+                return false;
+            }
+            if (fchmod(this->m_fd, mode) != 0 )
+            {
+                this->Close();
+                return false;
+            }
+
+            if (flags.find("d") != string::npos && !this->SetNoCache(true))
+            {
+                this->Close();
+                return false;
+            }
+
+            this->m_filename = filename;
+
+            return true;
+        }
+
+        bool Write(const void *data, size_t bytesToWrite, size_t *bytesWritten)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (bytesToWrite == 0)
+            {
+                return false;
+            }
+
+            *bytesWritten = write(this->m_fd.p(), data, bytesToWrite);
+
+            return (*bytesWritten > 0);
+        }
+
+        bool Read(void *data, size_t bytesToRead, size_t *bytesRead)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (bytesToRead == 0)
+            {
+                return false;
+            }
+
+            *bytesRead = read(this->m_fd.p(), data, bytesToRead);
+
+            return true;
+        }
+
+        //
+        // Method: SetNoCache
+        //
+        // (i) F_NOCACHE, the macOS counterpart of O_DIRECT. Data bypasses the unified buffer
+        //     cache. Transfers that are not block aligned are still served by the kernel.
+        //
+        bool SetNoCache(bool noCache)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+            return (fcntl(this->m_fd.p(), F_NOCACHE, noCache ? 1 : 0) != -1);
+        }
+
+        //
+        // Method: GetBlockSize
+        //
+        // (i) logical block size of the file system holding the file, the alignment to use
+        //     for uncached I/O buffers. 0 on failure.
+        //
+        size_t GetBlockSize()
+        {
+            if (this->IsInvalid())
+            {
+                return 0;
+            }
+
+            struct statfs sfs;
+            if (fstatfs(this->m_fd.p(), &sfs) == 0 && sfs.f_bsize > 0)
+            {
+                return static_cast<size_t>(sfs.f_bsize);
+            }
+
+            struct stat sb;
+            if (fstat(this->m_fd.p(), &sb) == 0 && sb.st_blksize > 0)
+            {
+                return static_cast<size_t>(sb.st_blksize);
+            }
+            return 0;
+        }
+
+        //
+        // Method: Advise
+        //
+        // (i) access pattern hint. macOS has no posix_fadvise, so:
+        //     Sequential/Random turn read-ahead on/off (F_RDAHEAD), WillNeed schedules
+        //     read-ahead of the range (F_RDADVISE), DontNeed stops further caching through
+        //     this descriptor (F_NOCACHE) and Normal restores the defaults.
+        //     length = 0 means to the end of the file.
+        //
+        bool Advise(ItsFileAccessHint hint, off_t offset = 0, off_t length = 0)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            switch (hint)
+            {
+                case ItsFileAccessHint::Normal:
+                    return (fcntl(this->m_fd.p(), F_RDAHEAD, 1) != -1 && fcntl(this->m_fd.p(), F_NOCACHE, 0) != -1);
+                case ItsFileAccessHint::Sequential:
+                    return (fcntl(this->m_fd.p(), F_RDAHEAD, 1) != -1);
+                case ItsFileAccessHint::Random:
+                    return (fcntl(this->m_fd.p(), F_RDAHEAD, 0) != -1);
+                case ItsFileAccessHint::WillNeed:
+                    return this->ReadAhead(offset, length);
+                case ItsFileAccessHint::DontNeed:
+                    return (fcntl(this->m_fd.p(), F_NOCACHE, 1) != -1);
+            }
+            return false;
+        }
+
+        //
+        // Method: ReadAhead
+        //
+        // (i) asks the kernel to start reading the range into the cache (F_RDADVISE)
+        //     and returns without waiting. length = 0 means to the end of the file.
+        //
+        bool ReadAhead(off_t offset, off_t length)
+        {
+            if (this->IsInvalid() || offset < 0 || length < 0)
+            {
+                return false;
+            }
+
+            if (length == 0)
+            {
+                struct stat sb;
+                if (fstat(this->m_fd.p(), &sb) != 0)
+                {
+                    return false;
+                }
+                length = std::max<off_t>(0, sb.st_size - offset);
+            }
+
+            // ra_count is an int
+            const off_t maxCount = 1024 * 1024 * 1024;
+            while (length > 0)
+            {
+                struct radvisory ra;
+                ra.ra_offset = offset;
+                ra.ra_count = static_cast<int>(std::min(length, maxCount));
+                if (fcntl(this->m_fd.p(), F_RDADVISE, &ra) == -1)
+                {
+                    return false;
+                }
+                offset += ra.ra_count;
+                length -= ra.ra_count;
+            }
+            return true;
+        }
+
+        //
+        // Method: Preallocate
+        //
+        // (i) reserves disk space for a file of length bytes (F_PREALLOCATE), trying a
+        //     contiguous allocation first. extendFileSize also sets the file size, like
+        //     posix_fallocate.
+        //
+        bool Preallocate(off_t length, bool extendFileSize)
+        {
+            if (this->IsInvalid() || length < 0)
+            {
+                return false;
+            }
+
+            struct stat sb;
+            if (fstat(this->m_fd.p(), &sb) != 0)
+            {
+                return false;
+            }
+
+            if (length <= sb.st_size)
+            {
+                return true;
+            }
+
+            fstore_t store{};
+            store.fst_flags = F_ALLOCATECONTIG | F_ALLOCATEALL;
+            store.fst_posmode = F_PEOFPOSMODE;
+            store.fst_offset = 0;
+            store.fst_length = length - sb.st_size;
+            if (fcntl(this->m_fd.p(), F_PREALLOCATE, &store) == -1)
+            {
+                store.fst_flags = F_ALLOCATEALL;
+                if (fcntl(this->m_fd.p(), F_PREALLOCATE, &store) == -1)
+                {
+                    return false;
+                }
+            }
+
+            if (extendFileSize && ftruncate(this->m_fd.p(), length) != 0)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        //
+        // Method: Prefetch
+        //
+        // (i) issues WillNeed read-ahead for a set of files in parallel so the cache is warm
+        //     before the first Read. Returns the number of files advised.
+        //
+        static size_t Prefetch(const vector<string>& filenames, size_t threadCount = 0)
+        {
+            std::atomic<size_t> advised{0};
+            {
+                ItsThreadPool pool(std::min(std::max<size_t>(filenames.size(), 1), (threadCount > 0) ? threadCount : static_cast<size_t>(std::max(1u, thread::hardware_concurrency()))));
+                for (const auto& filename : filenames)
+                {
+                    pool.Enqueue([&advised, &filename]() {
+                        ItsFile file;
+                        if (file.OpenExisting(filename, "r") && file.ReadAhead(0, 0))
+                        {
+                            advised++;
+                        }
+                    });
+                }
+            }
+            return advised;
+        }
+
+        //
+        // Method: ReadAt
+        //
+        // (i) positional read (pread). Does not move the file position, so one open file
+        //     can be read from several threads.
+        //
+        bool ReadAt(void *data, size_t bytesToRead, off_t offset, size_t *bytesRead)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (bytesToRead == 0)
+            {
+                return false;
+            }
+
+            ssize_t n;
+            do
+            {
+                n = pread(this->m_fd.p(), data, bytesToRead, offset);
+            } while (n < 0 && errno == EINTR);
+
+            if (n < 0)
+            {
+                *bytesRead = 0;
+                return false;
+            }
+
+            *bytesRead = static_cast<size_t>(n);
+            return true;
+        }
+
+        //
+        // Method: WriteAt
+        //
+        // (i) positional write (pwrite). Retries short writes and EINTR.
+        //
+        bool WriteAt(const void *data, size_t bytesToWrite, off_t offset, size_t *bytesWritten)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (bytesToWrite == 0)
+            {
+                return false;
+            }
+
+            struct iovec iov;
+            iov.iov_base = const_cast<void*>(data);
+            iov.iov_len = bytesToWrite;
+            return ItsFile::TransferV(this->m_fd.p(), vector<struct iovec>{iov}, offset, true, bytesWritten);
+        }
+
+        //
+        // Method: ReadV
+        //
+        // (i) scatter read (readv) from the current file position into buffers, in order.
+        //
+        bool ReadV(const vector<struct iovec>& buffers, size_t *bytesRead)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+            return ItsFile::TransferV(this->m_fd.p(), buffers, -1, false, bytesRead);
+        }
+
+        //
+        // Method: WriteV
+        //
+        // (i) gather write (writev) of buffers at the current file position, in one syscall
+        //     unless the kernel writes short.
+        //
+        bool WriteV(const vector<struct iovec>& buffers, size_t *bytesWritten)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+            return ItsFile::TransferV(this->m_fd.p(), buffers, -1, true, bytesWritten);
+        }
+
+        //
+        // Method: ReadVAt
+        //
+        // (i) positional scatter read (preadv).
+        //
+        bool ReadVAt(const vector<struct iovec>& buffers, off_t offset, size_t *bytesRead)
+        {
+            if (this->IsInvalid() || offset < 0)
+            {
+                return false;
+            }
+            return ItsFile::TransferV(this->m_fd.p(), buffers, offset, false, bytesRead);
+        }
+
+        //
+        // Method: WriteVAt
+        //
+        // (i) positional gather write (pwritev).
+        //
+        bool WriteVAt(const vector<struct iovec>& buffers, off_t offset, size_t *bytesWritten)
+        {
+            if (this->IsInvalid() || offset < 0)
+            {
+                return false;
+            }
+            return ItsFile::TransferV(this->m_fd.p(), buffers, offset, true, bytesWritten);
+        }
+
+        //
+        // Method: ReadAsync
+        //
+        // (i) positional read on ItsFileAsyncIO::GetDefault(). The file must stay open
+        //     and data valid until completion.
+        //
+        std::future<ItsFileIoResult> ReadAsync(void *data, size_t bytesToRead, off_t offset)
+        {
+            return ItsFileAsyncIO::GetDefault().Submit(this->CreateIoRequest(ItsFileIoOperation::Read, data, bytesToRead, offset));
+        }
+
+        void ReadAsync(void *data, size_t bytesToRead, off_t offset, function<void(const ItsFileIoResult&)> callback)
+        {
+            ItsFileAsyncIO::GetDefault().Submit(this->CreateIoRequest(ItsFileIoOperation::Read, data, bytesToRead, offset), callback);
+        }
+
+        //
+        // Method: WriteAsync
+        //
+        // (i) positional write on ItsFileAsyncIO::GetDefault(). Short writes are retried.
+        //
+        std::future<ItsFileIoResult> WriteAsync(const void *data, size_t bytesToWrite, off_t offset)
+        {
+            return ItsFileAsyncIO::GetDefault().Submit(this->CreateIoRequest(ItsFileIoOperation::Write, const_cast<void*>(data), bytesToWrite, offset));
+        }
+
+        void WriteAsync(const void *data, size_t bytesToWrite, off_t offset, function<void(const ItsFileIoResult&)> callback)
+        {
+            ItsFileAsyncIO::GetDefault().Submit(this->CreateIoRequest(ItsFileIoOperation::Write, const_cast<void*>(data), bytesToWrite, offset), callback);
+        }
+
+        //
+        // Method: FsyncAsync
+        //
+        // (i) fullSync = F_FULLFSYNC (flush drive cache), otherwise fsync.
+        //
+        std::future<ItsFileIoResult> FsyncAsync(bool fullSync = false)
+        {
+            return ItsFileAsyncIO::GetDefault().Submit(this->CreateIoRequest(fullSync ? ItsFileIoOperation::FullFsync : ItsFileIoOperation::Fsync, nullptr, 0, 0));
+        }
+
+        void FsyncAsync(bool fullSync, function<void(const ItsFileIoResult&)> callback)
+        {
+            ItsFileAsyncIO::GetDefault().Submit(this->CreateIoRequest(fullSync ? ItsFileIoOperation::FullFsync : ItsFileIoOperation::Fsync, nullptr, 0, 0), callback);
+        }
+
+        //
+        // ReadAllText
+        //
+        bool ReadAllText(string& str)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            this->SetPosFromBeg(0);
+
+            std::stringstream ss;
+
+            char data[2048];
+            size_t bytesRead(0);
+            while (this->Read(reinterpret_cast<void*>(data), 2048, &bytesRead) && bytesRead > 0)
+            {
+                ss.write(data, bytesRead);
+            }
+
+            str = ss.str();
+            return true;
+        }
+
+        //
+        // ReadAllTextLines
+        //
+        bool ReadAllTextLines(std::vector<string>& lines)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            this->SetPosFromBeg(0);
+
+            string str;
+            if (!this->ReadAllText(str))
+            {
+                return false;
+            }
+
+            string split("\n");
+            lines = ItsString::Split(str, split);
+            return true;
+        }
+
+        //
+        // Method: ForEachLine
+        //
+        // (i) streams the file from the beginning and calls func for each line (without '\n').
+        //     Lines are views into a reused buffer, valid only during the call. Return false
+        //     from func to stop. The buffer only grows when a single line exceeds it.
+        //
+        bool ForEachLine(function<bool(std::string_view)> func, size_t bufferSize = 64 * 1024)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (!this->SetPosFromBeg(0))
+            {
+                return false;
+            }
+
+            vector<char> buffer((bufferSize > 0) ? bufferSize : 64 * 1024);
+            size_t begin = 0;
+            size_t end = 0;
+            while (true)
+            {
+                if (end == buffer.size())
+                {
+                    if (begin > 0)
+                    {
+                        memmove(buffer.data(), buffer.data() + begin, end - begin);
+                        end -= begin;
+                        begin = 0;
+                    }
+                    else
+                    {
+                        buffer.resize(buffer.size() * 2);
+                    }
+                }
+
+                ssize_t bytesRead = read(this->m_fd.p(), buffer.data() + end, buffer.size() - end);
+                if (bytesRead < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+
+                if (bytesRead == 0)
+                {
+                    if (end > begin)
+                    {
+                        func(std::string_view(buffer.data() + begin, end - begin));
+                    }
+                    return true;
+                }
+
+                size_t scan = end;
+                end += static_cast<size_t>(bytesRead);
+                while (scan < end)
+                {
+                    const char* nl = static_cast<const char*>(memchr(buffer.data() + scan, '\n', end - scan));
+                    if (nl == nullptr)
+                    {
+                        break;
+                    }
+
+                    size_t pos = static_cast<size_t>(nl - buffer.data());
+                    if (!func(std::string_view(buffer.data() + begin, pos - begin)))
+                    {
+                        return true;
+                    }
+                    begin = pos + 1;
+                    scan = begin;
+                }
+
+                if (begin == end)
+                {
+                    begin = 0;
+                    end = 0;
+                }
+            }
+        }
+
+        static bool ForEachLine(string filename, function<bool(std::string_view)> func, size_t bufferSize = 64 * 1024)
+        {
+            ItsFile file;
+            if (!file.OpenExisting(filename, "r"))
+            {
+                return false;
+            }
+            return file.ForEachLine(func, bufferSize);
+        }
+
+        bool SetPosFromBeg(off_t offset)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (lseek(this->m_fd, offset, SEEK_SET) == -1)
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        bool SetPosFromEnd(off_t offset)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (lseek(this->m_fd, offset, SEEK_END) == -1)
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        bool SetPosFromCur(off_t offset)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (lseek(this->m_fd, offset, SEEK_CUR) == -1)
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        bool Close()
+        {
+            return this->m_fd.Close();
+        }
+
+        bool IsValid()
+        {
+            return this->m_fd.IsValid();
+        }
+
+        bool IsInvalid()
+        {
+            return this->m_fd.IsInvalid();
+        }
+
+        operator int()
+        {
+            return this->m_fd.p();
+        }
+
+        //
+        // GetFileSize
+        //
+        static size_t GetFileSize(string filename)
+        {
+            struct stat statbuf;
+            if ( stat(filename.c_str(), &statbuf) == -1 ) {
+                return -1;
+            }
+            return statbuf.st_size;
+        }
+
+        static bool Delete(string filename)
+        {
+            return (!unlink(filename.c_str()));
+        }
+
+        static bool Exists(string filename)
+        {
+            struct stat sb;
+            if(stat(filename.c_str(), &sb) == 0 && S_ISREG(sb.st_mode)) {
+                return true;
+            }
+            return false;
+        }
+
+        static bool Move(string sourceFilename, string targetFilename)
+        {
+            return (!rename(sourceFilename.c_str(), targetFilename.c_str()));
+        }
+
+        static bool Copy(string sourceFilename, string targetFilename, bool replaceIfExists)
+        {
+            ItsFileCopyOptions options;
+            options.replaceIfExists = replaceIfExists;
+            return ItsFile::Copy(sourceFilename, targetFilename, options, nullptr);
+        }
+
+        //
+        // Method: Copy
+        //
+        // (i) copies using the fastest strategy available, in order:
+        //     clonefile (APFS copy-on-write, O(1)), fcopyfile, then a large buffer read/write loop.
+        //     With preserveSparse only the data extents are copied and holes are left in the target.
+        //     With verify the read/write loop is used, the source is hashed while copying and
+        //     each written chunk is read back and hashed, so the target is verified in the same pass.
+        //     With delta an existing target is updated in place, rewriting only changed blocks.
+        //     Copying a file onto itself, directly or through a link, fails with EINVAL.
+        //
+        static bool Copy(string sourceFilename, string targetFilename, const ItsFileCopyOptions& options, ItsFileCopyResult* result)
+        {
+            if (result != nullptr)
+            {
+                *result = ItsFileCopyResult();
+            }
+
+            if (!ItsFile::Exists(sourceFilename))
+            {
+                return false;
+            }
+
+            bool targetExists = ItsFile::Exists(targetFilename);
+            if (targetExists && !options.replaceIfExists)
+            {
+                return false;
+            }
+
+            unique_file_handle source(open(sourceFilename.c_str(), O_RDONLY));
+            if (source.IsInvalid())
+            {
+                return false;
+            }
+
+            struct stat sb;
+            if (fstat(source.p(), &sb) != 0)
+            {
+                return false;
+            }
+
+            // the target may be the source itself, a hard link to it or a symbolic link to it
+            struct stat tb;
+            if (targetExists && stat(targetFilename.c_str(), &tb) == 0 && tb.st_dev == sb.st_dev && tb.st_ino == sb.st_ino)
+            {
+                errno = EINVAL;
+                return false;
+            }
+
+            if (options.delta && targetExists)
+            {
+                return ItsFile::CopyDelta(source.p(), targetFilename, sb, options, result);
+            }
+
+            if (options.allowClone && !options.verify && ItsFile::CopyClone(source.p(), targetFilename, targetExists))
+            {
+                if (result != nullptr)
+                {
+                    result->strategy = ItsFileCopyStrategy::Clone;
+                    result->bytesCopied = static_cast<uint64_t>(sb.st_size);
+                }
+                return true;
+            }
+
+            unique_file_handle target(open(targetFilename.c_str(), (options.verify ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC, sb.st_mode & 07777));
+            if (target.IsInvalid())
+            {
+                return false;
+            }
+            // open filters the mode through the umask; a new target gets the exact source mode
+            if (!targetExists && fchmod(target.p(), sb.st_mode & 07777) != 0)
+            {
+                return false;
+            }
+
+            size_t bufferSize = (options.bufferSize > 0) ? options.bufferSize : 1024 * 1024;
+            unique_ptr<uint8_t[]> buffer = make_unique<uint8_t[]>(bufferSize);
+
+            if (options.preserveSparse && !options.verify)
+            {
+                uint64_t dataCopied{0};
+                int sparseResult = ItsFile::CopySparse(source.p(), target.p(), sb.st_size, buffer.get(), bufferSize, options, &dataCopied);
+                if (sparseResult > 0)
+                {
+                    if (result != nullptr)
+                    {
+                        result->strategy = ItsFileCopyStrategy::Sparse;
+                        result->bytesCopied = dataCopied;
+                    }
+                    return true;
+                }
+                if (sparseResult < 0)
+                {
+                    return false;
+                }
+            }
+            else if (options.allowCopyFile && !options.verify && !ItsFile::IsControlled(options) && fcopyfile(source.p(), target.p(), nullptr, COPYFILE_DATA) == 0)
+            {
+                if (result != nullptr)
+                {
+                    result->strategy = ItsFileCopyStrategy::CopyFile;
+                    result->bytesCopied = static_cast<uint64_t>(sb.st_size);
+                }
+                return true;
+            }
+
+            // fcopyfile may have failed part way
+            if (lseek(source.p(), 0, SEEK_SET) == -1 ||
+                lseek(target.p(), 0, SEEK_SET) == -1 ||
+                ftruncate(target.p(), 0) != 0)
+            {
+                return false;
+            }
+
+            unique_ptr<uint8_t[]> verifyBuffer;
+            if (options.verify)
+            {
+                verifyBuffer = make_unique<uint8_t[]>(bufferSize);
+            }
+            ItsHasher sourceHasher(options.hashAlgorithm);
+            ItsHasher targetHasher(options.hashAlgorithm);
+
+            uint64_t totalCopied{0};
+            while (true)
+            {
+                ssize_t bytesRead = read(source.p(), buffer.get(), bufferSize);
+                if (bytesRead < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                if (bytesRead == 0)
+                {
+                    break;
+                }
+                if (!ItsFile::Throttle(options.rateLimiter, options.cancel, static_cast<uint64_t>(bytesRead)) ||
+                    !ItsFile::WriteAll(target.p(), buffer.get(), static_cast<size_t>(bytesRead)))
+                {
+                    return false;
+                }
+
+                if (options.verify)
+                {
+                    // read back what landed in the target while the chunk is still hot
+                    sourceHasher.Update(buffer.get(), static_cast<size_t>(bytesRead));
+                    size_t verified = 0;
+                    while (verified < static_cast<size_t>(bytesRead))
+                    {
+                        ssize_t n = pread(target.p(), verifyBuffer.get(), static_cast<size_t>(bytesRead) - verified, static_cast<off_t>(totalCopied + verified));
+                        if (n < 0 && errno == EINTR)
+                        {
+                            continue;
+                        }
+                        if (n <= 0)
+                        {
+                            return false;
+                        }
+                        targetHasher.Update(verifyBuffer.get(), static_cast<size_t>(n));
+                        verified += static_cast<size_t>(n);
+                    }
+                }
+                totalCopied += static_cast<uint64_t>(bytesRead);
+                if (options.progress)
+                {
+                    options.progress(totalCopied, static_cast<uint64_t>(sb.st_size));
+                }
+            }
+
+            if (result != nullptr)
+            {
+                result->strategy = ItsFileCopyStrategy::ReadWrite;
+                result->bytesCopied = totalCopied;
+            }
+
+            if (options.verify)
+            {
+                if (result != nullptr)
+                {
+                    result->digest = sourceHasher.GetDigest();
+                    result->verified = (sourceHasher.GetDigest() == targetHasher.GetDigest());
+                }
+                if (sourceHasher.GetDigest() != targetHasher.GetDigest())
+                {
+                    errno = EIO;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        //
+        // Method: CopyResumable
+        //
+        // (i) chunked copy that can be interrupted (even by kill -9) and resumed by running
+        //     it again. Completed chunks and their CRC32C are appended to a sidecar journal
+        //     (target + ".itsjournal") only after the chunk is written; a rerun skips them and
+        //     copies the remaining chunks in parallel. The journal is removed on completion.
+        //     A journal from a different source size, mtime or chunk size is discarded.
+        //     durable fsyncs each chunk before journaling it, to also survive power loss.
+        //     An existing target is only refused (unless replaceIfExists) when there is
+        //     no journal next to it; with one it is an interrupted copy, restarted from zero.
+        //
+        static bool CopyResumable(string sourceFilename, string targetFilename, const ItsFileResumableCopyOptions& options, ItsFileCopyResult* result)
+        {
+            if (result != nullptr)
+            {
+                *result = ItsFileCopyResult();
+            }
+
+            unique_file_handle source(open(sourceFilename.c_str(), O_RDONLY));
+            if (source.IsInvalid())
+            {
+                return false;
+            }
+
+            struct stat sb;
+            if (fstat(source.p(), &sb) != 0 || !S_ISREG(sb.st_mode))
+            {
+                return false;
+            }
+
+            const uint64_t chunkSize = (options.chunkSize > 0) ? options.chunkSize : 8 * 1024 * 1024;
+            const uint64_t chunkCount = (static_cast<uint64_t>(sb.st_size) + chunkSize - 1) / chunkSize;
+            const string journalFilename = targetFilename + ".itsjournal";
+
+            // header: magic, source size, mtime sec, mtime nsec, chunk size, crc32c of the preceding bytes
+            uint8_t header[48] = {0};
+            const uint64_t headerFields[4] = { static_cast<uint64_t>(sb.st_size), static_cast<uint64_t>(sb.st_mtimespec.tv_sec), static_cast<uint64_t>(sb.st_mtimespec.tv_nsec), chunkSize };
+            memcpy(header, "ITSJRNL1", 8);
+            memcpy(header + 8, headerFields, sizeof(headerFields));
+            uint32_t headerCrc = static_cast<uint32_t>(ItsHasher::Compute(ItsHashAlgorithm::Crc32c, header, 40));
+            memcpy(header + 40, &headerCrc, sizeof(headerCrc));
+
+            // load completed chunks from a matching journal
+            vector<uint8_t> completed(chunkCount, 0);
+            vector<uint32_t> completedCrc(chunkCount, 0);
+            bool resume = false;
+            bool journalExists = false;
+            {
+                unique_file_handle journal(open(journalFilename.c_str(), O_RDONLY));
+                uint8_t existingHeader[48];
+                size_t bytesRead = 0;
+                journalExists = journal.IsValid();
+                if (journal.IsValid() &&
+                    ItsFile::ReadFullyAt(journal.p(), existingHeader, sizeof(existingHeader), 0, &bytesRead) &&
+                    bytesRead == sizeof(existingHeader) &&
+                    memcmp(existingHeader, header, sizeof(header)) == 0 &&
+                    ItsFile::GetFileSize(targetFilename) == static_cast<size_t>(sb.st_size))
+                {
+                    resume = true;
+                    uint8_t record[16];
+                    off_t offset = sizeof(header);
+                    while (ItsFile::ReadFullyAt(journal.p(), record, sizeof(record), offset, &bytesRead) && bytesRead == sizeof(record))
+                    {
+                        uint64_t index;
+                        uint32_t crc;
+                        uint32_t check;
+                        memcpy(&index, record, 8);
+                        memcpy(&crc, record + 8, 4);
+                        memcpy(&check, record + 12, 4);
+                        if (check == static_cast<uint32_t>(ItsHasher::Compute(ItsHashAlgorithm::Crc32c, record, 12)) && index < chunkCount)
+                        {
+                            completed[index] = 1;
+                            completedCrc[index] = crc;
+                        }
+                        offset += sizeof(record);
+                    }
+                }
+            }
+
+            if (!resume)
+            {
+                if (!journalExists && ItsFile::Exists(targetFilename) && !options.replaceIfExists)
+                {
+                    errno = EEXIST;
+                    return false;
+                }
+
+                // the journal is in place, complete and synced, before the target is touched,
+                // so a kill at any point leaves either no target or a target with a journal
+                if (!ItsFile::ReplaceAtomic(journalFilename, header, sizeof(header), S_IRUSR | S_IWUSR))
+                {
+                    return false;
+                }
+
+                bool targetExists = ItsFile::Exists(targetFilename);
+                unique_file_handle target(open(targetFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, sb.st_mode & 07777));
+                if (target.IsInvalid() ||
+                    (!targetExists && fchmod(target.p(), sb.st_mode & 07777) != 0) ||
+                    ftruncate(target.p(), sb.st_size) != 0)
+                {
+                    return false;
+                }
+            }
+
+            unique_file_handle target(open(targetFilename.c_str(), O_RDWR));
+            unique_file_handle journal(open(journalFilename.c_str(), O_WRONLY | O_APPEND));
+            if (target.IsInvalid() || journal.IsInvalid())
+            {
+                return false;
+            }
+
+            vector<uint64_t> pending;
+            std::atomic<uint64_t> bytesSkipped{0};
+            std::atomic<uint64_t> bytesCopied{0};
+            std::atomic<bool> failed{false};
+            std::atomic<int> error{0};
+            std::mutex progressMutex;
+            {
+                ItsThreadPool pool(std::max<size_t>(1, options.threadCount));
+                auto chunkLength = [&](uint64_t index) {
+                    return static_cast<size_t>(std::min<uint64_t>(chunkSize, static_cast<uint64_t>(sb.st_size) - index * chunkSize));
+                };
+
+                // a journaled chunk is trusted only if the target still holds it
+                if (resume && options.verifyOnResume)
+                {
+                    for (uint64_t i = 0; i < chunkCount; i++)
+                    {
+                        if (!completed[i])
+                        {
+                            continue;
+                        }
+                        pool.Enqueue([&, i]() {
+                            unique_ptr<uint8_t[]> buffer = make_unique<uint8_t[]>(chunkLength(i));
+                            size_t bytesRead = 0;
+                            if (!ItsFile::ReadFullyAt(target.p(), buffer.get(), chunkLength(i), static_cast<off_t>(i * chunkSize), &bytesRead) ||
+                                bytesRead != chunkLength(i) ||
+                                static_cast<uint32_t>(ItsHasher::Compute(ItsHashAlgorithm::Crc32c, buffer.get(), bytesRead)) != completedCrc[i])
+                            {
+                                completed[i] = 0;
+                            }
+                        });
+                    }
+                    pool.WaitIdle();
+                }
+
+                for (uint64_t i = 0; i < chunkCount; i++)
+                {
+                    if (completed[i])
+                    {
+                        bytesSkipped += chunkLength(i);
+                    }
+                    else
+                    {
+                        pending.push_back(i);
+                    }
+                }
+
+                std::atomic<size_t> next{0};
+                for (size_t t = 0; t < pool.GetThreadCount(); t++)
+                {
+                    pool.Enqueue([&]() {
+                        unique_ptr<uint8_t[]> buffer = make_unique<uint8_t[]>(chunkSize);
+                        for (size_t n = next++; n < pending.size() && !failed; n = next++)
+                        {
+                            uint64_t index = pending[n];
+                            size_t length = chunkLength(index);
+                            off_t offset = static_cast<off_t>(index * chunkSize);
+                            size_t bytesRead = 0;
+                            size_t bytesWritten = 0;
+                            struct iovec iov;
+                            iov.iov_base = buffer.get();
+                            iov.iov_len = length;
+                            if (!ItsFile::Throttle(options.rateLimiter, options.cancel, length) ||
+                                !ItsFile::ReadFullyAt(source.p(), buffer.get(), length, offset, &bytesRead) ||
+                                bytesRead != length ||
+                                !ItsFile::TransferV(target.p(), vector<struct iovec>{iov}, offset, true, &bytesWritten) ||
+                                (options.durable && fsync(target.p()) != 0))
+                            {
+                                error = (errno != 0) ? errno : EIO;
+                                failed = true;
+                                return;
+                            }
+
+                            uint8_t record[16];
+                            uint32_t crc = static_cast<uint32_t>(ItsHasher::Compute(ItsHashAlgorithm::Crc32c, buffer.get(), length));
+                            memcpy(record, &index, 8);
+                            memcpy(record + 8, &crc, 4);
+                            uint32_t check = static_cast<uint32_t>(ItsHasher::Compute(ItsHashAlgorithm::Crc32c, record, 12));
+                            memcpy(record + 12, &check, 4);
+
+                            // a single O_APPEND write, so concurrent records never interleave
+                            if (write(journal.p(), record, sizeof(record)) != static_cast<ssize_t>(sizeof(record)) ||
+                                (options.durable && fsync(journal.p()) != 0))
+                            {
+                                error = (errno != 0) ? errno : EIO;
+                                failed = true;
+                                return;
+                            }
+                            bytesCopied += length;
+                            if (options.progress)
+                            {
+                                std::lock_guard<std::mutex> lock(progressMutex);
+                                options.progress(bytesSkipped + bytesCopied, static_cast<uint64_t>(sb.st_size));
+                            }
+                        }
+                    });
+                }
+            }
+
+            if (result != nullptr)
+            {
+                result->strategy = ItsFileCopyStrategy::Chunked;
+                result->bytesCopied = bytesCopied;
+                result->bytesSkipped = bytesSkipped;
+            }
+
+            if (failed)
+            {
+                errno = error;
+                return false;
+            }
+
+            if (fsync(target.p()) != 0)
+            {
+                return false;
+            }
+            journal.Close();
+            return ItsFile::Delete(journalFilename);
+        }
+
+        //
+        // Method: Splice
+        //
+        // (i) moves bytes (0 = until end of input) from sourceFd to targetFd, starting at
+        //     their current positions. Either end may be a file, pipe, FIFO or socket.
+        //     macOS has no splice(2): file to socket transfers stay in the kernel via
+        //     sendfile(2), everything else goes through one reused 256 KiB buffer.
+        //
+        static bool Splice(int sourceFd, int targetFd, size_t bytes, size_t *bytesTransferred)
+        {
+            *bytesTransferred = 0;
+
+            struct stat sourceStat;
+            struct stat targetStat;
+            if (fstat(sourceFd, &sourceStat) != 0 || fstat(targetFd, &targetStat) != 0)
+            {
+                return false;
+            }
+
+            if (S_ISREG(sourceStat.st_mode) && S_ISSOCK(targetStat.st_mode))
+            {
+                off_t offset = lseek(sourceFd, 0, SEEK_CUR);
+                if (offset != -1)
+                {
+                    bool bResult = true;
+                    while (bytes == 0 || *bytesTransferred < bytes)
+                    {
+                        off_t length = (bytes == 0) ? 0 : static_cast<off_t>(bytes - *bytesTransferred);
+                        int rc = sendfile(sourceFd, targetFd, offset, &length, nullptr, 0);
+                        offset += length;
+                        *bytesTransferred += static_cast<size_t>(length);
+                        if (rc == 0)
+                        {
+                            if (bytes == 0 || length == 0)
+                            {
+                                break;
+                            }
+                            continue;
+                        }
+                        if (errno == EINTR || errno == EAGAIN)
+                        {
+                            continue;
+                        }
+                        bResult = false;
+                        break;
+                    }
+
+                    lseek(sourceFd, offset, SEEK_SET);
+                    if (bResult || *bytesTransferred > 0)
+                    {
+                        return bResult;
+                    }
+                    if (errno != ENOTSUP && errno != EOPNOTSUPP)
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            return ItsFile::TeeBuffered(sourceFd, targetFd, -1, bytes, bytesTransferred);
+        }
+
+        static bool Splice(ItsFile& source, ItsFile& target, size_t bytes, size_t *bytesTransferred)
+        {
+            if (source.IsInvalid() || target.IsInvalid())
+            {
+                return false;
+            }
+            return ItsFile::Splice(source.m_fd.p(), target.m_fd.p(), bytes, bytesTransferred);
+        }
+
+        //
+        // Method: Tee
+        //
+        // (i) copies bytes (0 = until end of input) from sourceFd to both targetFd and
+        //     secondTargetFd. Unlike tee(2), which macOS lacks, the input is consumed; each
+        //     chunk is read once and written to both outputs.
+        //
+        static bool Tee(int sourceFd, int targetFd, int secondTargetFd, size_t bytes, size_t *bytesTransferred)
+        {
+            *bytesTransferred = 0;
+            return ItsFile::TeeBuffered(sourceFd, targetFd, secondTargetFd, bytes, bytesTransferred);
+        }
+
+        //
+        // Method: WriteAll
+        //
+        // (i) writes the whole buffer to fd, retrying on short writes and EINTR.
+        //     bytesWritten, if given, receives how much was written before an error.
+        //
+        static bool WriteAll(int fd, const void *data, size_t length, size_t *bytesWritten = nullptr)
+        {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            if (bytesWritten != nullptr)
+            {
+                *bytesWritten = 0;
+            }
+            while (length > 0)
+            {
+                ssize_t written = write(fd, p, length);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                p += written;
+                length -= static_cast<size_t>(written);
+                if (bytesWritten != nullptr)
+                {
+                    *bytesWritten += static_cast<size_t>(written);
+                }
+            }
+            return true;
+        }
+
+        //
+        // Method: ReplaceAtomic
+        //
+        // (i) crash safe replace of filename: writes a temporary sibling, flushes it to
+        //     the device, renames it into place and flushes the directory. A crash leaves
+        //     either the old or the new content, never a torn file.
+        //
+        static bool ReplaceAtomic(string filename, const void *data, size_t length, int mode)
+        {
+            string tempFilename;
+            unique_file_handle fd(ItsFile::CreateTempSibling(filename, mode, tempFilename));
+            if (fd.IsInvalid())
+            {
+                return false;
+            }
+
+            if (!ItsFile::WriteAll(fd, data, length) ||
+                (fcntl(fd, F_FULLFSYNC) != 0 && fsync(fd) != 0) ||
+                !fd.Close() ||
+                rename(tempFilename.c_str(), filename.c_str()) != 0)
+            {
+                int err = errno;
+                unlink(tempFilename.c_str());
+                errno = err;
+                return false;
+            }
+
+            return ItsFile::SyncDirectory(ItsFile::GetDirectoryName(filename), true);
+        }
+
+        static bool ReplaceAtomic(string filename, const string& text, int mode)
+        {
+            return ItsFile::ReplaceAtomic(filename, text.data(), text.size(), mode);
+        }
+
+        //
+        // Method: CreateTempSibling
+        //
+        // (i) creates a uniquely named hidden file with the given mode in the directory of
+        //     filename, so it can later be renamed over filename. Returns the open fd or -1.
+        //
+        static int CreateTempSibling(string filename, int mode, string& tempFilename)
+        {
+            if (filename.size() == 0)
+            {
+                return -1;
+            }
+
+            string name = filename.substr(filename.rfind('/') + 1);
+            string directory = ItsFile::GetDirectoryName(filename);
+            vector<char> templ;
+            string t = directory + "/." + name + ".XXXXXX";
+            templ.assign(t.begin(), t.end());
+            templ.push_back('\0');
+
+            int fd = mkstemp(templ.data());
+            if (fd < 0)
+            {
+                return -1;
+            }
+
+            tempFilename = templ.data();
+            if (fchmod(fd, mode & 07777) != 0)
+            {
+                int err = errno;
+                close(fd);
+                unlink(tempFilename.c_str());
+                errno = err;
+                return -1;
+            }
+            return fd;
+        }
+
+        //
+        // Method: SyncDirectory
+        //
+        // (i) makes directory entry changes (create, rename, unlink) durable.
+        //     fullSync = F_FULLFSYNC, which also flushes the drive cache.
+        //
+        static bool SyncDirectory(string path, bool fullSync)
+        {
+            unique_file_handle fd(open(path.c_str(), O_RDONLY | O_DIRECTORY));
+            if (fd.IsInvalid())
+            {
+                return false;
+            }
+
+            if (fullSync && fcntl(fd, F_FULLFSYNC) == 0)
+            {
+                return true;
+            }
+            return (fsync(fd) == 0);
+        }
+
+        //
+        // Method: GetDirectoryName
+        //
+        // (i) directory part of filename without trailing separator. "." when there is none.
+        //
+        static string GetDirectoryName(string filename)
+        {
+            auto i = filename.rfind('/');
+            if (i == string::npos)
+            {
+                return string(".");
+            }
+            if (i == 0)
+            {
+                return string("/");
+            }
+            return filename.substr(0, i);
+        }
+
+        //
+        // Method: Hash
+        //
+        // (i) streams the file through ItsHasher.
+        //
+        static bool Hash(string filename, ItsHashAlgorithm algorithm, uint64_t *digest)
+        {
+            unique_file_handle fd(open(filename.c_str(), O_RDONLY));
+            if (fd.IsInvalid())
+            {
+                return false;
+            }
+            return Hash(fd.p(), algorithm, digest);
+        }
+
+        //
+        // Method: Hash
+        //
+        // (i) streams an open file from its current position through ItsHasher.
+        //
+        static bool Hash(int fd, ItsHashAlgorithm algorithm, uint64_t *digest)
+        {
+            fcntl(fd, F_RDAHEAD, 1);
+
+            size_t bufferSize = 1024 * 1024;
+            struct stat sb;
+            if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode))
+            {
+                bufferSize = std::min<size_t>(bufferSize, std::max<size_t>(static_cast<size_t>(sb.st_size), 4096));
+            }
+            unique_ptr<uint8_t[]> buffer(new uint8_t[bufferSize]);
+            ItsHasher hasher(algorithm);
+            while (true)
+            {
+                ssize_t bytesRead = read(fd, buffer.get(), bufferSize);
+                if (bytesRead < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                if (bytesRead == 0)
+                {
+                    break;
+                }
+                hasher.Update(buffer.get(), static_cast<size_t>(bytesRead));
+            }
+
+            *digest = hasher.GetDigest();
+            return true;
+        }
+
+        //
+        // Method: HashFiles
+        //
+        // (i) hashes a file list in parallel. threadCount = 0 uses hardware_concurrency.
+        //
+        static vector<ItsFileHashResult> HashFiles(const vector<string>& filenames, ItsHashAlgorithm algorithm, size_t threadCount = 0)
+        {
+            vector<ItsFileHashResult> results(filenames.size());
+            {
+                ItsThreadPool pool(std::min(std::max<size_t>(filenames.size(), 1), (threadCount > 0) ? threadCount : static_cast<size_t>(std::max(1u, thread::hardware_concurrency()))));
+                for (size_t i = 0; i < filenames.size(); i++)
+                {
+                    pool.Enqueue([&, i]() {
+                        results[i].filename = filenames[i];
+                        results[i].success = ItsFile::Hash(filenames[i], algorithm, &results[i].digest);
+                    });
+                }
+            }
+            return results;
+        }
+
+        static bool GetMode(string filename, int *mode)
+        {
+            if (!ItsFile::Exists(filename))
+            {
+                return false;
+            }
+
+            struct stat stat1;
+            if (stat(filename.c_str(), &stat1) != 0)
+            {
+                return false;
+            }
+            *mode = stat1.st_mode;
+            return true;
+        }
+
+        static bool SetMode(string filename, int mode)
+        {
+            if (!ItsFile::Exists(filename))
+            {
+                return false;
+            }
+
+            struct stat stat1;
+            if (chmod(filename.c_str(), mode) != 0)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        static int CreateMode(string user, string group, string other)
+        {
+            int mode(0);
+
+            if (user.size() > 0)
+            {
+                if (user.find('r',0) != string::npos) {
+                    mode |= S_IRUSR;
+                }
+                if (user.find('w',0) != string::npos) {
+                    mode |= S_IWUSR;
+                }
+                if (user.find('x',0) != string::npos) {
+                    mode |= S_IXUSR;
+                }
+            }
+
+            if (group.size() > 0)
+            {
+                    if (group.find('r',0) != string::npos) {
+                        mode |= S_IRGRP;
+                    }
+                    if (group.find('w',0) != string::npos) {
+                        mode |= S_IWGRP;
+                    }
+                    if (group.find('x',0) != string::npos) {
+                        mode |= S_IXGRP;
+                    }
+            }
+
+            if (other.size() > 0)
+            {
+                if (other.find('r',0) != string::npos) {
+                        mode |= S_IROTH;
+                }
+                if (other.find('w',0) != string::npos) {
+                        mode |= S_IWOTH;
+                }
+                if (other.find('x',0) != string::npos) {
+                        mode |= S_IXOTH;
+                }
+            }
+
+            return mode;
+        }
+
+        static bool Shred(string filename, bool alsoDelete) 
+        {
+            ItsShredOptions options;
+            options.alsoDelete = alsoDelete;
+            return ItsFile::Shred(filename, options, nullptr);
+        }
+
+        //
+        // Method: Shred
+        //
+        // (i) overwrites the file once per pass with large page aligned buffers, syncing
+        //     to the device between passes so no pass is left in the page cache.
+        //     Optionally punches out the blocks (F_PUNCHHOLE) and deletes the file.
+        //
+        static bool Shred(string filename, const ItsShredOptions& options, ItsShredResult* result)
+        {
+            ItsShredResult localResult;
+            ItsShredResult& r = (result != nullptr) ? *result : localResult;
+            r = ItsShredResult();
+            r.filename = filename;
+
+            if (!ItsFile::Exists(filename))
+            {
+                r.error = ENOENT;
+                return false;
+            }
+
+            const size_t fileSize = ItsFile::GetFileSize(filename);
+            if (fileSize == 0 || options.passes.size() == 0)
+            {
+                r.error = EINVAL;
+                return false;
+            }
+
+            ItsFile f;
+            f.OpenExisting(filename, "rw");
+            if (f.IsInvalid())
+            {
+                r.error = errno;
+                return false;
+            }
+
+            if (options.noCache)
+            {
+                fcntl(f, F_NOCACHE, 1);
+            }
+
+            size_t pageSize = static_cast<size_t>(getpagesize());
+            size_t bufferSize = std::max(options.bufferSize, pageSize);
+            bufferSize -= bufferSize % pageSize;
+            bufferSize = std::min(bufferSize, fileSize + pageSize - (fileSize % pageSize));
+
+            void* pmem = nullptr;
+            if (posix_memalign(&pmem, pageSize, bufferSize) != 0)
+            {
+                r.error = ENOMEM;
+                return false;
+            }
+            unique_ptr<uint8_t, decltype(&free)> pdata(static_cast<uint8_t*>(pmem), &free);
+
+            uint64_t seed = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) ^ reinterpret_cast<uintptr_t>(pmem);
+            for (auto pattern : options.passes)
+            {
+                ItsShredPassResult pass;
+                pass.pattern = pattern;
+
+                if (pattern != ItsShredPattern::Random)
+                {
+                    memset(pdata.get(), (pattern == ItsShredPattern::Ones) ? 0xFF : 0x00, bufferSize);
+                }
+
+                ItsTimer timer;
+                timer.Start();
+                f.SetPosFromBeg(0);
+                while (pass.bytesWritten < fileSize)
+                {
+                    size_t count = std::min<size_t>(fileSize - pass.bytesWritten, bufferSize);
+                    if (pattern == ItsShredPattern::Random)
+                    {
+                        ItsFile::FillRandom(pdata.get(), count, seed);
+                    }
+                    if (!ItsFile::Throttle(options.rateLimiter, options.cancel, count) ||
+                        !ItsFile::WriteAll(f, pdata.get(), count))
+                    {
+                        r.error = errno;
+                        return false;
+                    }
+                    pass.bytesWritten += count;
+                    if (options.progress)
+                    {
+                        options.progress(r.passes.size() * fileSize + pass.bytesWritten, options.passes.size() * fileSize);
+                    }
+                }
+
+                if (options.syncBetweenPasses && fcntl(f, F_FULLFSYNC) != 0 && fsync(f) != 0)
+                {
+                    r.error = errno;
+                    return false;
+                }
+                timer.Stop();
+                pass.microseconds = timer.GetMicroseconds();
+                r.passes.push_back(pass);
+            }
+
+            if (options.punchHole)
+            {
+                // best effort, not every file system supports it
+                fpunchhole_t hole{};
+                hole.fp_offset = 0;
+                hole.fp_length = static_cast<off_t>(fileSize + pageSize - (fileSize % pageSize));
+                fcntl(f, F_PUNCHHOLE, &hole);
+            }
+            f.Close();
+
+            if (options.alsoDelete && !ItsFile::Delete(filename))
+            {
+                r.error = errno;
+                return false;
+            }
+
+            r.success = true;
+            return true;
+        }
+
+        //
+        // Method: ShredFiles
+        //
+        // (i) shreds many files in parallel. threadCount = 0 uses hardware_concurrency.
+        //
+        static vector<ItsShredResult> ShredFiles(const vector<string>& filenames, const ItsShredOptions& options, size_t threadCount = 0)
+        {
+            vector<ItsShredResult> results(filenames.size());
+            {
+                ItsThreadPool pool(std::min(filenames.size(), (threadCount > 0) ? threadCount : static_cast<size_t>(std::max(1u, thread::hardware_concurrency()))));
+                for (size_t i = 0; i < filenames.size(); i++)
+                {
+                    pool.Enqueue([&, i]() { ItsFile::Shred(filenames[i], options, &results[i]); });
+                }
+            }
+            return results;
+        }
+
+        static bool ShredAndDelete(string filename) 
+        {
+            return ItsFile::Shred(filename,true);
+        }
+    };
+
+    //
+    // class: ItsFileGroupCommit
+    //
+    // (i): Group commit of atomic file replacements. Add writes each new content to a
+    //      temporary sibling; Commit fsyncs them, pays for a single F_FULLFSYNC drive
+    //      cache flush per device for the whole batch, renames them into place and
+    //      flushes once more per directory. Add and Commit may be called from several
+    //      threads.
+    //
+    class ItsFileGroupCommit
+    {
+        private:
+        struct Pending
+        {
+            string filename;
+            string tempFilename;
+            int fd;
+        };
+        vector<Pending> m_pending;
+        std::mutex m_mutex;
+
+        static void Discard(vector<Pending>& pending)
+        {
+            for (auto& p : pending)
+            {
+                if (p.fd >= 0)
+                {
+                    close(p.fd);
+                }
+                unlink(p.tempFilename.c_str());
+            }
+            pending.clear();
+        }
+
+        protected:
+        public:
+        ItsFileGroupCommit()
+        {
+        }
+
+        ItsFileGroupCommit(const ItsFileGroupCommit&) = delete;
+        ItsFileGroupCommit& operator=(const ItsFileGroupCommit&) = delete;
+
+        //
+        // (i) uncommitted replacements are discarded.
+        //
+        ~ItsFileGroupCommit()
+        {
+            this->Abort();
+        }
+
+        //
+        // Method: Add
+        //
+        // (i) stages a replacement of filename. Nothing is visible until Commit.
+        //     Each staged file keeps one descriptor open until Commit or Abort.
+        //
+        bool Add(string filename, const void *data, size_t length, int mode)
+        {
+            Pending p;
+            p.filename = filename;
+            p.fd = ItsFile::CreateTempSibling(filename, mode, p.tempFilename);
+            if (p.fd < 0)
+            {
+                return false;
+            }
+
+            if (!ItsFile::WriteAll(p.fd, data, length))
+            {
+                int err = errno;
+                close(p.fd);
+                unlink(p.tempFilename.c_str());
+                errno = err;
+                return false;
+            }
+
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_pending.push_back(p);
+            return true;
+        }
+
+        bool Add(string filename, const string& text, int mode)
+        {
+            return this->Add(filename, text.data(), text.size(), mode);
+        }
+
+        //
+        // Method: Commit
+        //
+        // (i) makes all staged replacements durable and visible. If any staged file fails
+        //     to sync, no replacement is renamed into place and the batch is discarded.
+        //
+        bool Commit()
+        {
+            vector<Pending> pending;
+            {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                pending.swap(this->m_pending);
+            }
+
+            if (pending.size() == 0)
+            {
+                return true;
+            }
+
+            //
+            // fsync only hands the data to the drive, which may keep it in its cache. The
+            // data must be on the media before any rename can be, or a power loss could
+            // persist a new name over content that was never written. F_FULLFSYNC flushes
+            // the whole cache of the drive behind the file, so one per device covers the
+            // batch.
+            //
+            std::map<dev_t, int> devices;
+            for (auto& p : pending)
+            {
+                struct stat sb;
+                if (fsync(p.fd) != 0 || fstat(p.fd, &sb) != 0)
+                {
+                    int err = errno;
+                    ItsFileGroupCommit::Discard(pending);
+                    errno = err;
+                    return false;
+                }
+                devices.emplace(sb.st_dev, p.fd);
+            }
+            for (auto& device : devices)
+            {
+                if (fcntl(device.second, F_FULLFSYNC) != 0 && fsync(device.second) != 0)
+                {
+                    int err = errno;
+                    ItsFileGroupCommit::Discard(pending);
+                    errno = err;
+                    return false;
+                }
+            }
+            for (auto& p : pending)
+            {
+                close(p.fd);
+                p.fd = -1;
+            }
+
+            bool bResult = true;
+            vector<string> directories;
+            for (auto& p : pending)
+            {
+                if (rename(p.tempFilename.c_str(), p.filename.c_str()) != 0)
+                {
+                    unlink(p.tempFilename.c_str());
+                    bResult = false;
+                    continue;
+                }
+
+                string directory = ItsFile::GetDirectoryName(p.filename);
+                if (std::find(directories.begin(), directories.end(), directory) == directories.end())
+                {
+                    directories.push_back(directory);
+                }
+            }
+
+            for (auto& directory : directories)
+            {
+                if (!ItsFile::SyncDirectory(directory, true))
+                {
+                    bResult = false;
+                }
+            }
+
+            return bResult;
+        }
+
+        //
+        // Method: Abort
+        //
+        // (i) discards all staged replacements.
+        //
+        void Abort()
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            ItsFileGroupCommit::Discard(this->m_pending);
+        }
+
+        size_t GetPendingCount()
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            return this->m_pending.size();
+        }
+    };
+
+    //
+    // enum: ItsBufferedFileFlushPolicy
+    //
+    // (i): when ItsBufferedFile writes its buffer to the file. A full buffer is always flushed.
+    //
+    enum class ItsBufferedFileFlushPolicy
+    {
+        OnFull,
+        Explicit,
+        Interval,
+        EveryNRecords
+    };
+
+    //
+    // struct: ItsBufferedFileOptions
+    //
+    // (i): options for ItsBufferedFile. Flushes are paced by rateLimiter, or the
+    //      process budget when nullptr.
+    //
+    struct ItsBufferedFileOptions
+    {
+        size_t bufferSize = 64 * 1024;
+        ItsBufferedFileFlushPolicy flushPolicy = ItsBufferedFileFlushPolicy::OnFull;
+        uint32_t flushIntervalMs = 1000;
+        size_t flushEveryRecords = 0;
+        bool backgroundSync = false;
+        uint32_t backgroundSyncIntervalMs = 1000;
+        ItsRateLimiter* rateLimiter = nullptr;
+    };
+
+    //
+    // class: ItsBufferedFile
+    //
+    // (i): Buffered writer on top of ItsFile with a configurable flush policy
+    //      and optional background fsync.
+    //
+    class ItsBufferedFile
+    {
+        private:
+        ItsFile m_file;
+        ItsBufferedFileOptions m_options;
+        vector<uint8_t> m_buffer;
+        size_t m_used = 0;
+        size_t m_records = 0;
+        bool m_bDirty = false;
+        bool m_bStopped = false;
+        uint64_t m_bytesWritten = 0;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        thread m_thread;
+
+        ItsRateLimiter& GetRateLimiter()
+        {
+            return (this->m_options.rateLimiter != nullptr) ? *this->m_options.rateLimiter : ItsRateLimiter::GetProcess();
+        }
+
+        //
+        // (i) writes the buffer. The rate limiter budget is taken with the lock released,
+        //     so other writers are not stalled by the throttle. On a short write the
+        //     written bytes are dropped from the buffer, which then holds exactly what
+        //     the file is still missing.
+        //
+        bool FlushLocked(std::unique_lock<std::mutex>& lock)
+        {
+            this->m_records = 0;
+            if (this->m_used == 0)
+            {
+                return true;
+            }
+
+            ItsRateLimiter& limiter = this->GetRateLimiter();
+            if (limiter.IsLimited())
+            {
+                size_t bytes = this->m_used;
+                lock.unlock();
+                limiter.Acquire(bytes);
+                lock.lock();
+                if (this->m_used == 0)
+                {
+                    return true;
+                }
+            }
+
+            size_t written = 0;
+            bool bResult = ItsFile::WriteAll(this->m_file, this->m_buffer.data(), this->m_used, &written);
+            if (written > 0)
+            {
+                memmove(this->m_buffer.data(), this->m_buffer.data() + written, this->m_used - written);
+                this->m_used -= written;
+                this->m_bytesWritten += written;
+                this->m_bDirty = true;
+            }
+            return bResult;
+        }
+
+        void ExecuteBackgroundThread()
+        {
+            bool flushOnInterval = (this->m_options.flushPolicy == ItsBufferedFileFlushPolicy::Interval);
+            uint32_t intervalMs = flushOnInterval ? this->m_options.flushIntervalMs : this->m_options.backgroundSyncIntervalMs;
+            if (flushOnInterval && this->m_options.backgroundSync)
+            {
+                intervalMs = std::min(intervalMs, this->m_options.backgroundSyncIntervalMs);
+            }
+
+            ItsTimer syncTimer;
+            syncTimer.Start();
+
+            std::unique_lock<std::mutex> lock(this->m_mutex);
+            while (!this->m_bStopped)
+            {
+                this->m_cv.wait_for(lock, std::chrono::milliseconds(std::max<uint32_t>(1, intervalMs)));
+                if (this->m_bStopped)
+                {
+                    break;
+                }
+
+                if (flushOnInterval)
+                {
+                    this->FlushLocked(lock);
+                }
+
+                if (this->m_options.backgroundSync && this->m_bDirty &&
+                    syncTimer.LapMilliseconds() >= this->m_options.backgroundSyncIntervalMs)
+                {
+                    // fsync outside the lock so writers are not stalled by the device
+                    this->m_bDirty = false;
+                    int fd = this->m_file;
+                    lock.unlock();
+                    fsync(fd);
+                    lock.lock();
+                    syncTimer.Stop();
+                    syncTimer.Start();
+                }
+            }
+        }
+
+        bool Start(const ItsBufferedFileOptions& options)
+        {
+            this->m_options = options;
+            if (this->m_options.bufferSize == 0)
+            {
+                this->m_options.bufferSize = 64 * 1024;
+            }
+            this->m_buffer.resize(this->m_options.bufferSize);
+            this->m_used = 0;
+            this->m_records = 0;
+            this->m_bytesWritten = 0;
+            this->m_bDirty = false;
+            this->m_bStopped = false;
+
+            if (this->m_options.flushPolicy == ItsBufferedFileFlushPolicy::Interval || this->m_options.backgroundSync)
+            {
+                this->m_thread = thread(&ItsBufferedFile::ExecuteBackgroundThread, this);
+            }
+            return true;
+        }
+
+        protected:
+        public:
+        ItsBufferedFile()
+        {
+        }
+
+        ItsBufferedFile(const ItsBufferedFile&) = delete;
+        ItsBufferedFile& operator=(const ItsBufferedFile&) = delete;
+
+        ~ItsBufferedFile()
+        {
+            this->Close();
+        }
+
+        //
+        // Method: OpenOrCreate
+        //
+        // (i) flags and mode as ItsFile::OpenOrCreate.
+        //
+        bool OpenOrCreate(string filename, string flags, int mode, const ItsBufferedFileOptions& options)
+        {
+            if (!this->m_file.OpenOrCreate(filename, flags, mode))
+            {
+                return false;
+            }
+            return this->Start(options);
+        }
+
+        bool OpenExisting(string filename, string flags, const ItsBufferedFileOptions& options)
+        {
+            if (!this->m_file.OpenExisting(filename, flags))
+            {
+                return false;
+            }
+            return this->Start(options);
+        }
+
+        //
+        // Method: Write
+        //
+        // (i) appends one record to the buffer. Records larger than the buffer are
+        //     written straight through after flushing what is buffered.
+        //
+        bool Write(const void *data, size_t bytesToWrite)
+        {
+            if (this->m_file.IsInvalid())
+            {
+                return false;
+            }
+
+            bool writeThrough = (bytesToWrite > this->m_buffer.size());
+            if (writeThrough)
+            {
+                this->GetRateLimiter().Acquire(bytesToWrite);
+            }
+
+            std::unique_lock<std::mutex> lock(this->m_mutex);
+            while (bytesToWrite > this->m_buffer.size() - this->m_used && this->m_used > 0)
+            {
+                if (!this->FlushLocked(lock))
+                {
+                    return false;
+                }
+            }
+
+            if (writeThrough)
+            {
+                size_t written = 0;
+                bool bResult = ItsFile::WriteAll(this->m_file, data, bytesToWrite, &written);
+                if (written > 0)
+                {
+                    this->m_bytesWritten += written;
+                    this->m_bDirty = true;
+                }
+                return bResult;
+            }
+
+            memcpy(this->m_buffer.data() + this->m_used, data, bytesToWrite);
+            this->m_used += bytesToWrite;
+            this->m_records++;
+
+            if (this->m_options.flushPolicy == ItsBufferedFileFlushPolicy::EveryNRecords &&
+                this->m_options.flushEveryRecords > 0 &&
+                this->m_records >= this->m_options.flushEveryRecords)
+            {
+                return this->FlushLocked(lock);
+            }
+            return true;
+        }
+
+        bool Flush()
+        {
+            if (this->m_file.IsInvalid())
+            {
+                return false;
+            }
+
+            std::unique_lock<std::mutex> lock(this->m_mutex);
+            return this->FlushLocked(lock);
+        }
+
+        //
+        // Method: Sync
+        //
+        // (i) flushes the buffer and fsyncs the file.
+        //
+        bool Sync()
+        {
+            if (!this->Flush())
+            {
+                return false;
+            }
+            return (fsync(this->m_file) == 0);
+        }
+
+        //
+        // Method: GetBytesWritten
+        //
+        // (i) bytes handed to the kernel so far, excluding what is still buffered.
+        //
+        uint64_t GetBytesWritten()
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            return this->m_bytesWritten;
+        }
+
+        bool Close()
+        {
+            if (this->m_file.IsInvalid())
+            {
+                return false;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                this->m_bStopped = true;
+            }
+            this->m_cv.notify_all();
+            if (this->m_thread.joinable())
+            {
+                this->m_thread.join();
+            }
+
+            bool bResult = this->Flush();
+            if (this->m_options.backgroundSync && fsync(this->m_file) != 0)
+            {
+                bResult = false;
+            }
+            this->m_file.Close();
+            return bResult;
+        }
+
+        bool IsValid()
+        {
+            return this->m_file.IsValid();
+        }
+
+        bool IsInvalid()
+        {
+            return this->m_file.IsInvalid();
+        }
+    };
+
+    //
+    // enum: ItsMappedFileAccess
+    //
+    // (i): access mode of a memory mapped file view.
+    //
+    enum class ItsMappedFileAccess
+    {
+        ReadOnly,
+        ReadWrite
+    };
+
+    //
+    // enum: ItsMappedFileAdvice
+    //
+    // (i): madvise access pattern hints for a memory mapped file view.
+    //
+    enum class ItsMappedFileAdvice
+    {
+        Normal,
+        Sequential,
+        Random,
+        WillNeed,
+        DontNeed
+    };
+
+    //
+    // class: ItsMappedFile
+    //
+    // (i): Memory mapped file view. Companion to ItsFile for parsing files in place without copies.
+    //
+    class ItsMappedFile
+    {
+        private:
+        unique_file_handle m_fd;
+        string m_filename;
+        uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+        ItsMappedFileAccess m_access = ItsMappedFileAccess::ReadOnly;
+
+        bool Map()
+        {
+            if (this->m_size == 0)
+            {
+                this->m_data = nullptr;
+                return true;
+            }
+
+            int prot = PROT_READ;
+            if (this->m_access == ItsMappedFileAccess::ReadWrite)
+            {
+                prot |= PROT_WRITE;
+            }
+
+            void* data = mmap(nullptr, this->m_size, prot, MAP_SHARED, this->m_fd.p(), 0);
+            if (data == MAP_FAILED)
+            {
+                this->m_data = nullptr;
+                return false;
+            }
+
+            this->m_data = static_cast<uint8_t*>(data);
+            return true;
+        }
+
+        void Unmap()
+        {
+            if (this->m_data != nullptr)
+            {
+                munmap(this->m_data, this->m_size);
+                this->m_data = nullptr;
+            }
+        }
+
+        static int ToMadvise(ItsMappedFileAdvice advice)
+        {
+            switch (advice)
+            {
+                case ItsMappedFileAdvice::Sequential:
+                    return MADV_SEQUENTIAL;
+                case ItsMappedFileAdvice::Random:
+                    return MADV_RANDOM;
+                case ItsMappedFileAdvice::WillNeed:
+                    return MADV_WILLNEED;
+                case ItsMappedFileAdvice::DontNeed:
+                    return MADV_DONTNEED;
+                default:
+                    return MADV_NORMAL;
+            }
+        }
+
+        protected:
+        public:
+        ItsMappedFile()
+        {
+        }
+
+        ItsMappedFile(const ItsMappedFile&) = delete;
+        ItsMappedFile& operator=(const ItsMappedFile&) = delete;
+
+        ~ItsMappedFile()
+        {
+            this->Close();
+        }
+
+        //
+        // Method: OpenExisting
+        //
+        // (i) maps the whole of an existing file.
+        //
+        bool OpenExisting(string filename, ItsMappedFileAccess access)
+        {
+            if (this->m_fd.IsValid())
+            {
+                return false;
+            }
+
+            if (filename.size() == 0)
+            {
+                return false;
+            }
+
+            int i_flags = (access == ItsMappedFileAccess::ReadWrite) ? O_RDWR : O_RDONLY;
+            this->m_fd = open(filename.c_str(), i_flags);
+            if (this->m_fd.IsInvalid())
+            {
+                return false;
+            }
+
+            struct stat sb;
+            if (fstat(this->m_fd.p(), &sb) != 0 || !S_ISREG(sb.st_mode))
+            {
+                this->m_fd.Close();
+                return false;
+            }
+
+            this->m_access = access;
+            this->m_size = static_cast<size_t>(sb.st_size);
+            if (!this->Map())
+            {
+                this->m_size = 0;
+                this->m_fd.Close();
+                return false;
+            }
+
+            this->m_filename = filename;
+            return true;
+        }
+
+        //
+        // Method: OpenOrCreate
+        //
+        // (i) maps a file read-write, creating it with the given mode and size if it does not exist.
+        //     An existing file smaller than size is grown to size.
+        //
+        bool OpenOrCreate(string filename, int mode, size_t size)
+        {
+            if (this->m_fd.IsValid())
+            {
+                return false;
+            }
+
+            if (filename.size() == 0)
+            {
+                return false;
+            }
+
+            this->m_fd = open(filename.c_str(), O_RDWR | O_CREAT, mode);
+            if (this->m_fd.IsInvalid())
+            {
+                return false;
+            }
+            if (fchmod(this->m_fd.p(), mode) != 0)
+            {
+                this->m_fd.Close();
+                return false;
+            }
+
+            struct stat sb;
+            if (fstat(this->m_fd.p(), &sb) != 0 || !S_ISREG(sb.st_mode))
+            {
+                this->m_fd.Close();
+                return false;
+            }
+
+            if (static_cast<size_t>(sb.st_size) < size)
+            {
+                if (ftruncate(this->m_fd.p(), static_cast<off_t>(size)) != 0)
+                {
+                    this->m_fd.Close();
+                    return false;
+                }
+                sb.st_size = static_cast<off_t>(size);
+            }
+
+            this->m_access = ItsMappedFileAccess::ReadWrite;
+            this->m_size = static_cast<size_t>(sb.st_size);
+            if (!this->Map())
+            {
+                this->m_size = 0;
+                this->m_fd.Close();
+                return false;
+            }
+
+            this->m_filename = filename;
+            return true;
+        }
+
+        //
+        // Method: Resize
+        //
+        // (i) grows or shrinks a read-write mapping together with the underlying file.
+        //     Pointers and views obtained before the call are invalidated. Written pages
+        //     stay in the page cache; use Flush to write them to the file.
+        //
+        bool Resize(size_t newSize)
+        {
+            if (this->IsInvalid() || this->m_access != ItsMappedFileAccess::ReadWrite)
+            {
+                return false;
+            }
+
+            if (newSize == this->m_size)
+            {
+                return true;
+            }
+
+            this->Unmap();
+
+            size_t oldSize = this->m_size;
+            if (ftruncate(this->m_fd.p(), static_cast<off_t>(newSize)) != 0)
+            {
+                this->Map();
+                return false;
+            }
+
+            this->m_size = newSize;
+            if (!this->Map())
+            {
+                this->m_size = oldSize;
+                ftruncate(this->m_fd.p(), static_cast<off_t>(oldSize));
+                this->Map();
+                return false;
+            }
+
+            return true;
+        }
+
+        //
+        // Method: Flush
+        //
+        // (i) msync's dirty pages of the mapping to the file. async = MS_ASYNC, otherwise MS_SYNC.
+        //
+        bool Flush(bool async = false)
+        {
+            return this->Flush(0, this->m_size, async);
+        }
+
+        bool Flush(size_t offset, size_t length, bool async)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (this->m_data == nullptr || length == 0)
+            {
+                return true;
+            }
+
+            if (offset >= this->m_size)
+            {
+                return false;
+            }
+
+            length = std::min(length, this->m_size - offset);
+
+            // msync requires a page aligned address
+            size_t pageSize = static_cast<size_t>(getpagesize());
+            size_t alignedOffset = offset - (offset % pageSize);
+            length += (offset - alignedOffset);
+
+            return (msync(this->m_data + alignedOffset, length, async ? MS_ASYNC : MS_SYNC) == 0);
+        }
+
+        //
+        // Method: Advise
+        //
+        // (i) madvise access pattern hint for the whole or a part of the mapping.
+        //
+        bool Advise(ItsMappedFileAdvice advice)
+        {
+            return this->Advise(advice, 0, this->m_size);
+        }
+
+        bool Advise(ItsMappedFileAdvice advice, size_t offset, size_t length)
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            if (this->m_data == nullptr || length == 0)
+            {
+                return true;
+            }
+
+            if (offset >= this->m_size)
+            {
+                return false;
+            }
+
+            length = std::min(length, this->m_size - offset);
+
+            size_t pageSize = static_cast<size_t>(getpagesize());
+            size_t alignedOffset = offset - (offset % pageSize);
+            length += (offset - alignedOffset);
+
+            return (madvise(this->m_data + alignedOffset, length, ItsMappedFile::ToMadvise(advice)) == 0);
+        }
+
+        //
+        // Method: GetView
+        //
+        // (i) zero-copy view of the mapping. Valid until Resize or Close.
+        //
+        std::string_view GetView() const
+        {
+            if (this->m_data == nullptr)
+            {
+                return std::string_view();
+            }
+            return std::string_view(reinterpret_cast<const char*>(this->m_data), this->m_size);
+        }
+
+        std::string_view GetView(size_t offset, size_t length) const
+        {
+            if (this->m_data == nullptr || offset >= this->m_size)
+            {
+                return std::string_view();
+            }
+            return std::string_view(reinterpret_cast<const char*>(this->m_data) + offset, std::min(length, this->m_size - offset));
+        }
+
+        const uint8_t* GetData() const
+        {
+            return this->m_data;
+        }
+
+        //
+        // Method: GetMutableData
+        //
+        // (i) writable pointer to the mapping. nullptr for read-only mappings.
+        //
+        uint8_t* GetMutableData()
+        {
+            if (this->m_access != ItsMappedFileAccess::ReadWrite)
+            {
+                return nullptr;
+            }
+            return this->m_data;
+        }
+
+        size_t GetSize() const
+        {
+            return this->m_size;
+        }
+
+        string GetFilename()
+        {
+            return this->m_filename;
+        }
+
+        //
+        // Method: Close
+        //
+        // (i) unmaps the view without flushing it; call Flush first if the writes must
+        //     reach the file before Close returns.
+        //
+        bool Close()
+        {
+            if (this->IsInvalid())
+            {
+                return false;
+            }
+
+            this->Unmap();
+            this->m_size = 0;
+            this->m_filename.clear();
+            return this->m_fd.Close();
+        }
+
+        bool IsValid() const
+        {
+            return this->m_fd.IsValid();
+        }
+
+        bool IsInvalid() const
+        {
+            return this->m_fd.IsInvalid();
+        }
+    };
+
+    //
+    // enum: ItsDirectoryEntryType
+    //
+    // (i): type of an entry returned by ItsDirectoryReader and ItsDirectory::Enumerate.
+    //
+    enum class ItsDirectoryEntryType
+    {
+        Unknown,
+        File,
+        Directory,
+        Symlink,
+        Other
+    };
+
+    //
+    // struct: ItsDirectoryEntry
+    //
+    // (i): name, type and inode of a directory entry.
+    //
+    struct ItsDirectoryEntry
+    {
+        string name;
+        ItsDirectoryEntryType type = ItsDirectoryEntryType::Unknown;
+        uint64_t inode = 0;
+    };
+
+    //
+    // struct: ItsDirectoryEntryView
+    //
+    // (i): non-owning directory entry. name points into the buffer of the
+    //      ItsDirectoryReader that produced it.
+    //
+    struct ItsDirectoryEntryView
+    {
+        std::string_view name;
+        ItsDirectoryEntryType type = ItsDirectoryEntryType::Unknown;
+        uint64_t inode = 0;
+    };
+
+    //
+    // class: ItsDirectoryReader
+    //
+    // (i): Reads the entries of a directory in bulk with getattrlistbulk, which returns
+    //      name, type and inode for many entries per system call. Falls back to readdir
+    //      on file systems that do not support it. "." and ".." are never returned.
+    //
+    class ItsDirectoryReader
+    {
+        private:
+        int m_fd = -1;
+        bool m_ownsFd = true;
+        DIR* m_dir = nullptr;
+        vector<uint64_t> m_buffer;
+        const uint8_t* m_cursor = nullptr;
+        int m_remaining = 0;
+        int m_error = 0;
+
+        protected:
+        static ItsDirectoryEntryType FromObjectType(fsobj_type_t type)
+        {
+            switch (type)
+            {
+                case VREG: return ItsDirectoryEntryType::File;
+                case VDIR: return ItsDirectoryEntryType::Directory;
+                case VLNK: return ItsDirectoryEntryType::Symlink;
+                case VNON: return ItsDirectoryEntryType::Unknown;
+                default: return ItsDirectoryEntryType::Other;
+            }
+        }
+
+        static ItsDirectoryEntryType FromDirentType(unsigned char type)
+        {
+            switch (type)
+            {
+                case DT_REG: return ItsDirectoryEntryType::File;
+                case DT_DIR: return ItsDirectoryEntryType::Directory;
+                case DT_LNK: return ItsDirectoryEntryType::Symlink;
+                case DT_UNKNOWN: return ItsDirectoryEntryType::Unknown;
+                default: return ItsDirectoryEntryType::Other;
+            }
+        }
+
+        ItsDirectoryEntryType StatType(const char* name) const
+        {
+            struct stat sb;
+            if (fstatat(this->GetFd(), name, &sb, AT_SYMLINK_NOFOLLOW) != 0) {
+                return ItsDirectoryEntryType::Unknown;
+            }
+            if (S_ISREG(sb.st_mode)) {
+                return ItsDirectoryEntryType::File;
+            }
+            if (S_ISDIR(sb.st_mode)) {
+                return ItsDirectoryEntryType::Directory;
+            }
+            if (S_ISLNK(sb.st_mode)) {
+                return ItsDirectoryEntryType::Symlink;
+            }
+            return ItsDirectoryEntryType::Other;
+        }
+
+        bool NextBulk(ItsDirectoryEntryView& entry)
+        {
+            while (true)
+            {
+                if (this->m_remaining == 0)
+                {
+                    struct attrlist attrList = {};
+                    attrList.bitmapcount = ATTR_BIT_MAP_COUNT;
+                    attrList.commonattr = ATTR_CMN_RETURNED_ATTRS | ATTR_CMN_NAME | ATTR_CMN_ERROR | ATTR_CMN_OBJTYPE | ATTR_CMN_FILEID;
+
+                    int count = getattrlistbulk(this->m_fd, &attrList, this->m_buffer.data(), this->m_buffer.size() * sizeof(uint64_t), 0);
+                    if (count < 0) {
+                        if ((errno == ENOTSUP || errno == EINVAL) && this->m_cursor == nullptr) {
+                            return this->BeginReaddir() && this->NextReaddir(entry);
+                        }
+                        this->m_error = errno;
+                        return false;
+                    }
+                    if (count == 0) {
+                        return false;
+                    }
+                    this->m_remaining = count;
+                    this->m_cursor = reinterpret_cast<const uint8_t*>(this->m_buffer.data());
+                }
+
+                const uint8_t* field = this->m_cursor;
+                uint32_t length;
+                memcpy(&length, field, sizeof(length));
+                field += sizeof(length);
+                this->m_cursor += length;
+                this->m_remaining--;
+
+                attribute_set_t returned;
+                memcpy(&returned, field, sizeof(returned));
+                field += sizeof(returned);
+
+                uint32_t error = 0;
+                if (returned.commonattr & ATTR_CMN_ERROR) {
+                    memcpy(&error, field, sizeof(error));
+                    field += sizeof(error);
+                }
+
+                const char* name = nullptr;
+                size_t nameLength = 0;
+                if (returned.commonattr & ATTR_CMN_NAME) {
+                    attrreference_t reference;
+                    memcpy(&reference, field, sizeof(reference));
+                    name = reinterpret_cast<const char*>(field) + reference.attr_dataoffset;
+                    nameLength = strnlen(name, reference.attr_length);
+                    field += sizeof(reference);
+                }
+
+                if (error != 0 || name == nullptr) {
+                    continue;
+                }
+
+                fsobj_type_t objectType = VNON;
+                if (returned.commonattr & ATTR_CMN_OBJTYPE) {
+                    memcpy(&objectType, field, sizeof(objectType));
+                    field += sizeof(objectType);
+                }
+
+                uint64_t fileId = 0;
+                if (returned.commonattr & ATTR_CMN_FILEID) {
+                    memcpy(&fileId, field, sizeof(fileId));
+                    field += sizeof(fileId);
+                }
+
+                entry.name = std::string_view(name, nameLength);
+                entry.type = FromObjectType(objectType);
+                entry.inode = fileId;
+                if (entry.type == ItsDirectoryEntryType::Unknown) {
+                    entry.type = this->StatType(name);
+                }
+                return true;
+            }
+        }
+
+        bool BeginReaddir()
+        {
+            int fd = this->m_ownsFd ? this->m_fd : fcntl(this->m_fd, F_DUPFD_CLOEXEC, 0);
+            if (fd < 0) {
+                this->m_error = errno;
+                return false;
+            }
+            this->m_dir = fdopendir(fd);
+            if (this->m_dir == nullptr) {
+                this->m_error = errno;
+                if (!this->m_ownsFd) {
+                    close(fd);
+                }
+                return false;
+            }
+            this->m_fd = -1;
+            this->m_ownsFd = true;
+            return true;
+        }
+
+        void Release()
+        {
+            if (this->m_dir != nullptr) {
+                closedir(this->m_dir);
+            }
+            else if (this->m_fd >= 0 && this->m_ownsFd) {
+                close(this->m_fd);
+            }
+            this->m_dir = nullptr;
+            this->m_fd = -1;
+            this->m_cursor = nullptr;
+            this->m_remaining = 0;
+            this->m_error = 0;
+        }
+
+        bool NextReaddir(ItsDirectoryEntryView& entry)
+        {
+            struct dirent* de;
+
+            errno = 0;
+            while ((de = readdir(this->m_dir)) != nullptr)
+            {
+                if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+                    continue;
+                }
+
+                entry.name = std::string_view(de->d_name);
+                entry.type = FromDirentType(de->d_type);
+                entry.inode = de->d_ino;
+                if (entry.type == ItsDirectoryEntryType::Unknown) {
+                    entry.type = this->StatType(de->d_name);
+                }
+                return true;
+            }
+
+            this->m_error = errno;
+            return false;
+        }
+
+        public:
+        static constexpr size_t DefaultBufferSize = 256 * 1024;
+
+        //
+        // Method: ItsDirectoryReader
+        //
+        // (i) fd must be a directory opened for reading. The reader closes it when
+        //     ownsFd is true.
+        //
+        explicit ItsDirectoryReader(int fd, size_t bufferSize = DefaultBufferSize, bool ownsFd = true)
+            : m_fd(fd),
+              m_ownsFd(ownsFd)
+        {
+            this->m_buffer.resize(std::max<size_t>(bufferSize, 4096) / sizeof(uint64_t));
+            if (fd < 0) {
+                this->m_error = EBADF;
+            }
+        }
+
+        explicit ItsDirectoryReader(const string& path, size_t bufferSize = DefaultBufferSize)
+            : m_fd(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC))
+        {
+            if (this->m_fd < 0) {
+                this->m_error = errno;
+            }
+            this->m_buffer.resize(std::max<size_t>(bufferSize, 4096) / sizeof(uint64_t));
+        }
+
+        ItsDirectoryReader(const ItsDirectoryReader&) = delete;
+        ItsDirectoryReader& operator=(const ItsDirectoryReader&) = delete;
+
+        ~ItsDirectoryReader()
+        {
+            this->Release();
+        }
+
+        //
+        // Method: Reset
+        //
+        // (i) starts reading another directory, reusing the read buffer.
+        //
+        void Reset(int fd, bool ownsFd = true)
+        {
+            this->Release();
+            this->m_fd = fd;
+            this->m_ownsFd = ownsFd;
+            if (fd < 0) {
+                this->m_error = EBADF;
+            }
+        }
+
+        //
+        // Method: Next
+        //
+        // (i) reads the next entry. Returns false at the end of the directory or on error,
+        //     in which case GetError returns the errno value. entry.name is valid until
+        //     the next call.
+        //
+        bool Next(ItsDirectoryEntryView& entry)
+        {
+            if (this->m_error != 0) {
+                return false;
+            }
+            if (this->m_dir != nullptr) {
+                return this->NextReaddir(entry);
+            }
+            return this->NextBulk(entry);
+        }
+
+        int GetFd() const
+        {
+            return (this->m_dir != nullptr) ? dirfd(this->m_dir) : this->m_fd;
+        }
+
+        int GetError() const
+        {
+            return this->m_error;
+        }
+
+        //
+        // class: iterator
+        //
+        // (i): single-pass input iterator over the entries of an ItsDirectoryReader.
+        //      Each entry is only valid until the iterator is incremented.
+        //
+        class iterator
+        {
+            private:
+            ItsDirectoryReader* m_reader = nullptr;
+            ItsDirectoryEntryView m_entry;
+
+            public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = ItsDirectoryEntryView;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const ItsDirectoryEntryView*;
+            using reference = const ItsDirectoryEntryView&;
+
+            iterator() = default;
+
+            explicit iterator(ItsDirectoryReader* reader)
+                : m_reader(reader)
+            {
+                ++(*this);
+            }
+
+            reference operator*() const
+            {
+                return this->m_entry;
+            }
+
+            pointer operator->() const
+            {
+                return &this->m_entry;
+            }
+
+            iterator& operator++()
+            {
+                if (this->m_reader != nullptr && !this->m_reader->Next(this->m_entry)) {
+                    this->m_reader = nullptr;
+                }
+                return *this;
+            }
+
+            bool operator==(const iterator& other) const
+            {
+                return (this->m_reader == other.m_reader);
+            }
+
+            bool operator!=(const iterator& other) const
+            {
+                return (this->m_reader != other.m_reader);
+            }
+        };
+
+        //
+        // Method: begin
+        //
+        // (i) the reader is a single-pass range. Names are views into the reused read
+        //     buffer, so nothing is allocated per entry.
+        //
+        iterator begin()
+        {
+            return iterator(this);
+        }
+
+        iterator end()
+        {
+            return iterator();
+        }
+
+        bool IsValid() const
+        {
+            return (this->m_fd >= 0 || this->m_dir != nullptr);
+        }
+    };
+
+    //
+    // class: ItsDirectoryListing
+    //
+    // (i): Materialized directory listing. All names are stored back to back, null
+    //      terminated, in one arena, with a table of offsets, types and inodes. Costs
+    //      two allocations that grow geometrically instead of one string per entry.
+    //
+    class ItsDirectoryListing
+    {
+        private:
+        struct Record
+        {
+            uint64_t inode;
+            uint64_t offset;
+            uint32_t length;
+            ItsDirectoryEntryType type;
+        };
+
+        vector<char> m_names;
+        vector<Record> m_records;
+
+        protected:
+        ItsDirectoryEntryView ToView(const Record& record) const
+        {
+            return ItsDirectoryEntryView{ std::string_view(this->m_names.data() + record.offset, record.length), record.type, record.inode };
+        }
+
+        public:
+        //
+        // class: iterator
+        //
+        // (i): random access by index over the listing.
+        //
+        class iterator
+        {
+            private:
+            const ItsDirectoryListing* m_listing = nullptr;
+            size_t m_index = 0;
+
+            public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = ItsDirectoryEntryView;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = ItsDirectoryEntryView;
+
+            iterator() = default;
+
+            iterator(const ItsDirectoryListing* listing, size_t index)
+                : m_listing(listing),
+                  m_index(index)
+            {
+            }
+
+            ItsDirectoryEntryView operator*() const
+            {
+                return (*this->m_listing)[this->m_index];
+            }
+
+            iterator& operator++()
+            {
+                this->m_index++;
+                return *this;
+            }
+
+            bool operator==(const iterator& other) const
+            {
+                return (this->m_index == other.m_index);
+            }
+
+            bool operator!=(const iterator& other) const
+            {
+                return (this->m_index != other.m_index);
+            }
+        };
+
+        //
+        // Method: Load
+        //
+        // (i) replaces the listing with the entries of path. Returns false and sets
+        //     errno on failure.
+        //
+        bool Load(const string& path)
+        {
+            this->Clear();
+
+            ItsDirectoryReader reader(path);
+            for (auto& entry : reader) {
+                this->Append(entry);
+            }
+
+            if (reader.GetError() != 0) {
+                errno = reader.GetError();
+                return false;
+            }
+            return true;
+        }
+
+        void Append(const ItsDirectoryEntryView& entry)
+        {
+            this->m_records.push_back(Record{ entry.inode, this->m_names.size(), static_cast<uint32_t>(entry.name.size()), entry.type });
+            this->m_names.insert(this->m_names.end(), entry.name.begin(), entry.name.end());
+            this->m_names.push_back('\0');
+        }
+
+        //
+        // Method: SortByName
+        //
+        // (i) sorts the offsets table by name; the arena is left untouched.
+        //
+        void SortByName()
+        {
+            std::sort(this->m_records.begin(), this->m_records.end(), [this](const Record& a, const Record& b) {
+                return std::string_view(this->m_names.data() + a.offset, a.length) < std::string_view(this->m_names.data() + b.offset, b.length);
+            });
+        }
+
+        void Clear()
+        {
+            this->m_names.clear();
+            this->m_records.clear();
+        }
+
+        ItsDirectoryEntryView operator[](size_t index) const
+        {
+            return this->ToView(this->m_records[index]);
+        }
+
+        //
+        // Method: GetName
+        //
+        // (i) null terminated name, usable directly with the *at system calls.
+        //
+        const char* GetName(size_t index) const
+        {
+            return this->m_names.data() + this->m_records[index].offset;
+        }
+
+        size_t size() const
+        {
+            return this->m_records.size();
+        }
+
+        bool empty() const
+        {
+            return this->m_records.empty();
+        }
+
+        iterator begin() const
+        {
+            return iterator(this, 0);
+        }
+
+        iterator end() const
+        {
+            return iterator(this, this->m_records.size());
+        }
+
+        size_t GetArenaSize() const
+        {
+            return this->m_names.size();
+        }
+    };
+
+    //
+    // struct: ItsDirectoryWalkEntry
+    //
+    // (i): entry passed to the ItsDirectory::Walk callbacks. path and name point into a
+    //      buffer of the walking thread and are only valid during the call. dirFd is the
+    //      open parent directory, for use with the *at system calls.
+    //
+    struct ItsDirectoryWalkEntry
+    {
+        std::string_view path;
+        std::string_view name;
+        ItsDirectoryEntryType type = ItsDirectoryEntryType::Unknown;
+        uint64_t inode = 0;
+        int depth = 0;
+        int dirFd = -1;
+    };
+
+    //
+    // struct: ItsDirectoryWalkOptions
+    //
+    // (i): options for ItsDirectory::Walk. Entries of the root are at depth 1 and
+    //      maxDepth = 0 is unlimited. prune returns true to not descend into a
+    //      directory. maxOpenFiles bounds the directory descriptors kept open for
+    //      openat; beyond it subdirectories are opened one component at a time from
+    //      their nearest open ancestor. The callbacks are called concurrently from
+    //      the walking threads.
+    //
+    struct ItsDirectoryWalkOptions
+    {
+        int maxDepth = 0;
+        bool followSymlinks = false;
+        bool sameFileSystem = false;
+        size_t threadCount = 0;
+        size_t maxOpenFiles = 256;
+        size_t bufferSize = 64 * 1024;
+        std::function<bool(const ItsDirectoryWalkEntry&)> prune;
+        std::function<void(std::string_view path, int error)> error;
+        const ItsCancellationToken* cancel = nullptr;
+    };
+
+    //
+    // struct: ItsDirectoryWalkResult
+    //
+    struct ItsDirectoryWalkResult
+    {
+        uint64_t directories = 0;
+        uint64_t entries = 0;
+        uint64_t errors = 0;
+    };
+
+    //
+    // class: ItsDirectoryWalker
+    //
+    // (i): Parallel recursive directory walker behind ItsDirectory::Walk. Every thread
+    //      owns a deque of directories: it takes its own newest work first (depth
+    //      first, keeping the parent descriptor hot) and steals the oldest work of
+    //      the other threads when it runs dry. Subdirectories are opened with openat
+    //      relative to their parent, so no path is resolved twice.
+    //
+    class ItsDirectoryWalker
+    {
+        private:
+        struct SharedDirectory
+        {
+            int fd;
+            std::atomic<size_t>* openCount;
+
+            SharedDirectory(int fd, std::atomic<size_t>* openCount)
+                : fd(fd),
+                  openCount(openCount)
+            {
+            }
+
+            ~SharedDirectory()
+            {
+                close(this->fd);
+                this->openCount->fetch_sub(1);
+            }
+        };
+
+        struct Task
+        {
+            std::shared_ptr<SharedDirectory> parent;
+            string path;
+            size_t nameOffset = 0;
+            int depth = 0;
+        };
+
+        struct Worker
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        const ItsDirectoryWalkOptions& m_options;
+        std::function<void(const ItsDirectoryWalkEntry&)> m_callback;
+        vector<std::unique_ptr<Worker>> m_workers;
+        std::mutex m_idleMutex;
+        std::condition_variable m_idleCondition;
+        std::atomic<size_t> m_queued{0};
+        std::atomic<size_t> m_pending{0};
+        std::atomic<size_t> m_openShared{0};
+        std::atomic<uint64_t> m_directories{0};
+        std::atomic<uint64_t> m_entries{0};
+        std::atomic<uint64_t> m_errors{0};
+        dev_t m_rootDevice = 0;
+        std::mutex m_visitedMutex;
+        std::set<std::pair<dev_t, ino_t>> m_visited;
+
+        protected:
+        bool IsCancelled() const
+        {
+            return (this->m_options.cancel != nullptr && this->m_options.cancel->IsCancelled());
+        }
+
+        void ReportError(std::string_view path, int error)
+        {
+            this->m_errors++;
+            if (this->m_options.error) {
+                this->m_options.error(path, error);
+            }
+        }
+
+        void Push(size_t worker, Task&& task)
+        {
+            this->m_pending++;
+            {
+                std::lock_guard<std::mutex> lock(this->m_workers[worker]->mutex);
+                this->m_workers[worker]->tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> lock(this->m_idleMutex);
+                this->m_queued++;
+            }
+            this->m_idleCondition.notify_one();
+        }
+
+        bool TryPop(size_t worker, Task& task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->m_workers[worker]->mutex);
+                auto& tasks = this->m_workers[worker]->tasks;
+                if (!tasks.empty()) {
+                    task = std::move(tasks.back());
+                    tasks.pop_back();
+                    this->m_queued--;
+                    return true;
+                }
+            }
+
+            for (size_t i = 1; i < this->m_workers.size(); i++)
+            {
+                auto& victim = *this->m_workers[(worker + i) % this->m_workers.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    this->m_queued--;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Finish()
+        {
+            if (--this->m_pending == 0) {
+                std::lock_guard<std::mutex> lock(this->m_idleMutex);
+                this->m_idleCondition.notify_all();
+            }
+        }
+
+        //
+        // Opens path + offset, which may be several components deep, relative to dirFd.
+        // Every component is opened with openat, so without followSymlinks a symbolic
+        // link swapped in above the last component is not followed either.
+        //
+        int OpenRelative(int dirFd, const string& path, size_t offset, int flags)
+        {
+            int intermediateFlags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+            if (!this->m_options.followSymlinks) {
+                intermediateFlags |= O_NOFOLLOW;
+            }
+
+            int fd = dirFd;
+            string component;
+            while (true)
+            {
+                size_t slash = path.find('/', offset);
+                int next = (slash == string::npos) ? openat(fd, path.c_str() + offset, flags)
+                                                   : openat(fd, component.assign(path, offset, slash - offset).c_str(), intermediateFlags);
+                if (fd != dirFd) {
+                    int err = errno;
+                    close(fd);
+                    errno = err;
+                }
+                if (next < 0 || slash == string::npos) {
+                    return next;
+                }
+                fd = next;
+                offset = slash + 1;
+            }
+        }
+
+        void Process(size_t worker, Task& task, ItsDirectoryReader& reader, string& pathBuffer)
+        {
+            if (this->IsCancelled()) {
+                return;
+            }
+
+            int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+            if (task.depth > 0 && !this->m_options.followSymlinks) {
+                flags |= O_NOFOLLOW;
+            }
+            std::shared_ptr<SharedDirectory> ancestor = std::move(task.parent);
+            int fd = (ancestor) ? this->OpenRelative(ancestor->fd, task.path, task.nameOffset, flags)
+                                : open(task.path.c_str(), flags);
+            if (fd < 0) {
+                this->ReportError(task.path, errno);
+                return;
+            }
+
+            if (this->m_options.sameFileSystem || this->m_options.followSymlinks)
+            {
+                struct stat sb;
+                if (fstat(fd, &sb) != 0) {
+                    this->ReportError(task.path, errno);
+                    close(fd);
+                    return;
+                }
+                if (this->m_options.sameFileSystem && sb.st_dev != this->m_rootDevice) {
+                    close(fd);
+                    return;
+                }
+                if (this->m_options.followSymlinks) {
+                    std::lock_guard<std::mutex> lock(this->m_visitedMutex);
+                    if (!this->m_visited.insert(std::make_pair(sb.st_dev, sb.st_ino)).second) {
+                        close(fd);
+                        return;
+                    }
+                }
+            }
+            this->m_directories++;
+
+            pathBuffer.assign(task.path);
+            if (pathBuffer.empty() || pathBuffer.back() != '/') {
+                pathBuffer.push_back('/');
+            }
+            size_t base = pathBuffer.size();
+            int depth = task.depth + 1;
+            bool descend = (this->m_options.maxDepth <= 0 || depth < this->m_options.maxDepth);
+
+            std::shared_ptr<SharedDirectory> shared;
+            uint64_t entries = 0;
+            reader.Reset(fd, false);
+            for (auto& e : reader)
+            {
+                if (this->IsCancelled()) {
+                    break;
+                }
+
+                pathBuffer.resize(base);
+                pathBuffer.append(e.name);
+                entries++;
+
+                ItsDirectoryWalkEntry entry;
+                entry.path = pathBuffer;
+                entry.name = std::string_view(pathBuffer).substr(base);
+                entry.type = e.type;
+                entry.inode = e.inode;
+                entry.depth = depth;
+                entry.dirFd = fd;
+
+                bool isDirectory = (e.type == ItsDirectoryEntryType::Directory);
+                if (e.type == ItsDirectoryEntryType::Symlink && this->m_options.followSymlinks) {
+                    struct stat sb;
+                    isDirectory = (fstatat(fd, pathBuffer.c_str() + base, &sb, 0) == 0 && S_ISDIR(sb.st_mode));
+                }
+
+                if (this->m_callback) {
+                    this->m_callback(entry);
+                }
+
+                //
+                // Past maxOpenFiles a subdirectory is opened from the nearest ancestor
+                // that is still open. Root has none, so it is always kept open.
+                //
+                if (isDirectory && descend && !(this->m_options.prune && this->m_options.prune(entry)))
+                {
+                    if (!shared && (!ancestor || this->m_openShared.load() < this->m_options.maxOpenFiles)) {
+                        this->m_openShared++;
+                        shared = std::make_shared<SharedDirectory>(fd, &this->m_openShared);
+                    }
+                    if (shared) {
+                        this->Push(worker, Task{ shared, pathBuffer, base, depth });
+                    }
+                    else {
+                        this->Push(worker, Task{ ancestor, pathBuffer, task.nameOffset, depth });
+                    }
+                }
+            }
+            this->m_entries += entries;
+
+            if (reader.GetError() != 0) {
+                this->ReportError(task.path, reader.GetError());
+            }
+            reader.Reset(-1, false);
+            if (!shared) {
+                close(fd);
+            }
+        }
+
+        void Run(size_t worker)
+        {
+            ItsDirectoryReader reader(-1, this->m_options.bufferSize, false);
+            string pathBuffer;
+            Task task;
+
+            while (true)
+            {
+                if (this->TryPop(worker, task)) {
+                    this->Process(worker, task, reader, pathBuffer);
+                    task = Task();
+                    this->Finish();
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(this->m_idleMutex);
+                this->m_idleCondition.wait(lock, [this] { return this->m_queued > 0 || this->m_pending == 0; });
+                if (this->m_pending == 0) {
+                    return;
+                }
+            }
+        }
+
+        public:
+        ItsDirectoryWalker(const ItsDirectoryWalkOptions& options, std::function<void(const ItsDirectoryWalkEntry&)> callback)
+            : m_options(options),
+              m_callback(std::move(callback))
+        {
+        }
+
+        ItsDirectoryWalker(const ItsDirectoryWalker&) = delete;
+        ItsDirectoryWalker& operator=(const ItsDirectoryWalker&) = delete;
+
+        //
+        // Method: Walk
+        //
+        // (i) walks root on threadCount threads, the calling thread included. Returns
+        //     false and sets errno if root is not a directory or the walk was cancelled.
+        //     Errors below root are counted and passed to options.error.
+        //
+        bool Walk(const string& root, ItsDirectoryWalkResult* result = nullptr)
+        {
+            struct stat sb;
+            if (stat(root.c_str(), &sb) != 0) {
+                return false;
+            }
+            if (!S_ISDIR(sb.st_mode)) {
+                errno = ENOTDIR;
+                return false;
+            }
+            this->m_rootDevice = sb.st_dev;
+
+            size_t threadCount = this->m_options.threadCount;
+            if (threadCount == 0) {
+                threadCount = std::max<size_t>(1, thread::hardware_concurrency());
+            }
+            this->m_workers.clear();
+            for (size_t i = 0; i < threadCount; i++) {
+                this->m_workers.push_back(std::make_unique<Worker>());
+            }
+
+            this->Push(0, Task{ nullptr, root, 0, 0 });
+
+            vector<thread> threads;
+            for (size_t i = 1; i < threadCount; i++) {
+                threads.emplace_back([this, i] { this->Run(i); });
+            }
+            this->Run(0);
+            for (auto& t : threads) {
+                t.join();
+            }
+
+            if (result != nullptr) {
+                result->directories = this->m_directories;
+                result->entries = this->m_entries;
+                result->errors = this->m_errors;
+            }
+
+            if (this->IsCancelled()) {
+                errno = ECANCELED;
+                return false;
+            }
+            return true;
+        }
+    };
+
+    //
+    // struct: ItsDirectoryUsage
+    //
+    // (i): space used by a directory tree. apparentSize is the sum of st_size,
+    //      allocatedSize the sum of st_blocks * 512. The directories themselves
+    //      are included.
+    //
+    struct ItsDirectoryUsage
+    {
+        uint64_t apparentSize = 0;
+        uint64_t allocatedSize = 0;
+        uint64_t files = 0;
+        uint64_t directories = 0;
+
+        void Add(const ItsDirectoryUsage& other)
+        {
+            this->apparentSize += other.apparentSize;
+            this->allocatedSize += other.allocatedSize;
+            this->files += other.files;
+            this->directories += other.directories;
+        }
+    };
+
+    //
+    // struct: ItsDirectoryUsageOptions
+    //
+    // (i): options for ItsDirectory::GetUsage. aggregateDepth is how many levels of
+    //      subdirectories get their own entry in the result, 0 for all of them.
+    //
+    struct ItsDirectoryUsageOptions
+    {
+        ItsDirectoryWalkOptions walk;
+        int aggregateDepth = 1;
+        bool countHardLinksOnce = true;
+    };
+
+    //
+    // struct: ItsDirectoryUsageResult
+    //
+    // (i): total usage of the tree and the recursive usage of each reported
+    //      subdirectory, keyed by path.
+    //
+    struct ItsDirectoryUsageResult
+    {
+        ItsDirectoryUsage total;
+        std::map<string, ItsDirectoryUsage> directories;
+        uint64_t errors = 0;
+    };
+
+    //
+    // struct: ItsDirectoryRemoveOptions
+    //
+    // (i): options for ItsDirectory::RemoveTree. walk.followSymlinks, walk.maxDepth
+    //      and walk.prune are ignored; symbolic links are always removed, never
+    //      followed. walk.maxOpenFiles bounds the directories removed in parallel.
+    //
+    struct ItsDirectoryRemoveOptions
+    {
+        ItsDirectoryWalkOptions walk;
+        bool removeRoot = true;
+    };
+
+    //
+    // struct: ItsDirectoryRemoveResult
+    //
+    struct ItsDirectoryRemoveResult
+    {
+        uint64_t filesRemoved = 0;
+        uint64_t directoriesRemoved = 0;
+        uint64_t errors = 0;
+    };
+
+    //
+    // struct: ItsDirectory
+    //
+    // (i): macOS directory routines.
+    //
+    struct ItsDirectory
+    {
+    public:
+        static bool Exists(string dirname)
+        {
+            struct stat sb;
+
+            if (stat(dirname.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode)) {
+                return true;
+            }
+
+            return false;
+        }
+        static bool CreateDirectory(string path, int mode)
+        {
+            return (mkdir(path.c_str(), mode) == 0);
+        }
+        static bool RemoveDirectory(string path)
+        {
+            return (rmdir(path.c_str()) == 0);
+        }
+
+        //
+        // Method: RemoveTree
+        //
+        // (i) removes a directory and everything below it (rm -rf). Every entry is
+        //     removed with unlinkat relative to its open parent directory, which is
+        //     opened with openat and O_NOFOLLOW, so no path is resolved again and a
+        //     symbolic link swapped into the tree is removed, never followed. A
+        //     directory is removed once all of its subdirectories are gone; the
+        //     subdirectories are removed in parallel on a thread pool.
+        //
+        static bool RemoveTree(string root, const ItsDirectoryRemoveOptions& options = ItsDirectoryRemoveOptions(), ItsDirectoryRemoveResult* result = nullptr)
+        {
+            ItsDirectoryRemoveResult local;
+            ItsDirectoryRemoveResult& r = (result != nullptr) ? *result : local;
+            r = ItsDirectoryRemoveResult();
+
+            while (root.size() > 1 && root.back() == '/') {
+                root.pop_back();
+            }
+
+            struct stat sb;
+            if (lstat(root.c_str(), &sb) != 0) {
+                return false;
+            }
+            if (!S_ISDIR(sb.st_mode)) {
+                if (!options.removeRoot) {
+                    errno = ENOTDIR;
+                    return false;
+                }
+                if (unlink(root.c_str()) != 0) {
+                    return false;
+                }
+                r.filesRemoved = 1;
+                return true;
+            }
+
+            ItsThreadPool pool(options.walk.threadCount);
+            RemoveContext context(options, pool, sb.st_dev);
+
+            //
+            // To remove root itself it is opened, and finally removed, relative to
+            // its parent directory like any other directory in the tree.
+            //
+            std::shared_ptr<RemoveNode> top;
+            size_t nameOffset = 0;
+            if (options.removeRoot) {
+                size_t slash = root.rfind('/');
+                string parent = (slash == string::npos) ? string(".") : ((slash == 0) ? string("/") : root.substr(0, slash));
+                int fd = open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (fd < 0) {
+                    return false;
+                }
+                context.openCount++;
+                top = std::make_shared<RemoveNode>();
+                top->fd = fd;
+                top->path = parent;
+                top->pending++;
+                nameOffset = (slash == string::npos) ? 0 : slash + 1;
+            }
+
+            RemoveAt(context, top, root, nameOffset);
+            pool.WaitIdle();
+            RemoveComplete(context, top);
+
+            r.filesRemoved = context.filesRemoved;
+            r.directoriesRemoved = context.directoriesRemoved;
+            r.errors = context.errors;
+            if (context.IsCancelled()) {
+                errno = ECANCELED;
+                return false;
+            }
+            if (r.errors > 0) {
+                errno = EIO;
+                return false;
+            }
+            return true;
+        }
+
+        static bool SetCurrentDirectory(string path)
+        {
+            return (chdir(path.c_str()) == 0);
+        }
+        static vector<string> GetDirectories(string path) {
+            vector<string> directories;
+            for (auto& entry : Enumerate(path)) {
+                if (entry.type == ItsDirectoryEntryType::Directory) {
+                    directories.push_back(std::move(entry.name));
+                }
+            }
+            return directories;
+        }
+        static vector<string> GetFiles(string path) {
+            vector<string> files;
+            for (auto& entry : Enumerate(path)) {
+                if (entry.type == ItsDirectoryEntryType::File) {
+                    files.push_back(std::move(entry.name));
+                }
+            }
+            return files;
+        }
+
+        //
+        // Method: Enumerate
+        //
+        // (i) Lists name, type and inode of every entry in a directory in a single pass,
+        //     using ItsDirectoryReader. Entries whose type the file system does not report
+        //     are resolved with fstatat. "." and ".." are not included.
+        //
+        static bool Enumerate(string path, vector<ItsDirectoryEntry>& entries)
+        {
+            if (path.size() == 0) {
+                errno = ENOENT;
+                return false;
+            }
+
+            ItsDirectoryReader reader(path);
+            for (auto& entry : reader) {
+                entries.push_back(ItsDirectoryEntry{ string(entry.name), entry.type, entry.inode });
+            }
+
+            if (reader.GetError() != 0) {
+                errno = reader.GetError();
+                return false;
+            }
+            return true;
+        }
+
+        static vector<ItsDirectoryEntry> Enumerate(string path)
+        {
+            vector<ItsDirectoryEntry> entries;
+            Enumerate(path, entries);
+            return entries;
+        }
+
+        //
+        // Method: Walk
+        //
+        // (i) recursively walks root in parallel with ItsDirectoryWalker, calling callback
+        //     for every entry below root. callback is called concurrently.
+        //
+        static bool Walk(string root, std::function<void(const ItsDirectoryWalkEntry&)> callback, const ItsDirectoryWalkOptions& options, ItsDirectoryWalkResult* result = nullptr)
+        {
+            ItsDirectoryWalker walker(options, std::move(callback));
+            return walker.Walk(root, result);
+        }
+
+        static bool Walk(string root, std::function<void(const ItsDirectoryWalkEntry&)> callback)
+        {
+            ItsDirectoryWalkOptions options;
+            return Walk(root, std::move(callback), options);
+        }
+
+        //
+        // Method: GetUsage
+        //
+        // (i) computes the apparent and allocated size of a tree in parallel (du). Every
+        //     entry is stat'ed exactly once with fstatat relative to its open parent
+        //     directory. Files with more than one link are counted once per (dev, inode).
+        //
+        static bool GetUsage(string root, ItsDirectoryUsageResult& result, const ItsDirectoryUsageOptions& options = ItsDirectoryUsageOptions())
+        {
+            constexpr size_t ShardCount = 64;
+            struct Shard
+            {
+                std::mutex mutex;
+                std::unordered_map<string, ItsDirectoryUsage> usage;
+                std::set<std::pair<dev_t, ino_t>> links;
+            };
+
+            while (root.size() > 1 && root.back() == '/') {
+                root.pop_back();
+            }
+
+            struct stat sb;
+            if (stat(root.c_str(), &sb) != 0) {
+                return false;
+            }
+
+            vector<Shard> shards(ShardCount);
+            std::atomic<uint64_t> errors{0};
+            std::hash<std::string_view> hasher;
+
+            ItsDirectoryWalkResult walkResult;
+            bool bResult = Walk(root, [&](const ItsDirectoryWalkEntry& entry) {
+                struct stat st;
+                if (fstatat(entry.dirFd, entry.path.data() + (entry.path.size() - entry.name.size()), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    errors++;
+                    return;
+                }
+
+                if (options.countHardLinksOnce && st.st_nlink > 1 && !S_ISDIR(st.st_mode)) {
+                    auto& shard = shards[(static_cast<size_t>(st.st_ino) * 31 + static_cast<size_t>(st.st_dev)) % ShardCount];
+                    std::lock_guard<std::mutex> lock(shard.mutex);
+                    if (!shard.links.insert(std::make_pair(st.st_dev, st.st_ino)).second) {
+                        return;
+                    }
+                }
+
+                //
+                // A directory is booked on itself, anything else on its parent.
+                //
+                ItsDirectoryUsage usage;
+                usage.apparentSize = static_cast<uint64_t>(st.st_size);
+                usage.allocatedSize = static_cast<uint64_t>(st.st_blocks) * 512;
+                std::string_view key = entry.path;
+                if (S_ISDIR(st.st_mode)) {
+                    usage.directories = 1;
+                }
+                else {
+                    usage.files = 1;
+                    key = entry.path.substr(0, entry.path.size() - entry.name.size());
+                    if (key.size() > 1) {
+                        key.remove_suffix(1);
+                    }
+                }
+
+                auto& shard = shards[hasher(key) % ShardCount];
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                shard.usage[string(key)].Add(usage);
+            }, options.walk, &walkResult);
+
+            //
+            // Children sort after their parent, so walking the paths in reverse order
+            // rolls every directory up into its parent before the parent is visited.
+            // The root only gets a key from files directly inside it, so make sure it
+            // exists for the top level directories to roll up into.
+            //
+            std::map<string, ItsDirectoryUsage> tree;
+            tree[root];
+            for (auto& shard : shards) {
+                for (auto& u : shard.usage) {
+                    tree[u.first].Add(u.second);
+                }
+                shard.usage.clear();
+            }
+            for (auto it = tree.rbegin(); it != tree.rend(); ++it)
+            {
+                if (it->first == root) {
+                    continue;
+                }
+                size_t slash = it->first.rfind('/');
+                string parent = (slash == 0) ? string("/") : it->first.substr(0, slash);
+                auto p = tree.find(parent);
+                if (p != tree.end()) {
+                    p->second.Add(it->second);
+                }
+            }
+
+            result.total = ItsDirectoryUsage();
+            result.total.apparentSize = static_cast<uint64_t>(sb.st_size);
+            result.total.allocatedSize = static_cast<uint64_t>(sb.st_blocks) * 512;
+            result.total.directories = 1;
+            result.total.Add(tree[root]);
+
+            result.directories.clear();
+            size_t rootDepth = std::count(root.begin(), root.end(), '/') - ((root == "/") ? 1 : 0);
+            for (auto& t : tree)
+            {
+                if (t.first == root) {
+                    continue;
+                }
+                size_t depth = std::count(t.first.begin(), t.first.end(), '/') - rootDepth;
+                if (options.aggregateDepth <= 0 || depth <= static_cast<size_t>(options.aggregateDepth)) {
+                    result.directories.emplace(t.first, t.second);
+                }
+            }
+            result.errors = errors + walkResult.errors;
+
+            return bResult;
+        }
+
+    private:
+        //
+        // Directory being removed by RemoveTree. fd is kept open until every
+        // subdirectory below it is gone, as they are removed relative to it. pending
+        // counts the subdirectories still being removed, plus one for the directory's
+        // own entries.
+        //
+        struct RemoveNode
+        {
+            int fd = -1;
+            std::shared_ptr<RemoveNode> parent;
+            string path;
+            size_t nameOffset = 0;
+            std::atomic<size_t> pending{1};
+        };
+
+        struct RemoveContext
+        {
+            const ItsDirectoryRemoveOptions& options;
+            ItsThreadPool& pool;
+            dev_t rootDevice;
+            std::atomic<size_t> openCount{0};
+            std::atomic<uint64_t> filesRemoved{0};
+            std::atomic<uint64_t> directoriesRemoved{0};
+            std::atomic<uint64_t> errors{0};
+
+            RemoveContext(const ItsDirectoryRemoveOptions& options, ItsThreadPool& pool, dev_t rootDevice)
+                : options(options),
+                  pool(pool),
+                  rootDevice(rootDevice)
+            {
+            }
+
+            bool IsCancelled() const
+            {
+                return (this->options.walk.cancel != nullptr && this->options.walk.cancel->IsCancelled());
+            }
+
+            void ReportError(std::string_view path, int error)
+            {
+                this->errors++;
+                if (this->options.walk.error) {
+                    this->options.walk.error(path, error);
+                }
+            }
+        };
+
+        //
+        // Method: RemoveAt
+        //
+        // (i) removes the directory path + nameOffset below parent, or path itself when
+        //     parent is null. Files are unlinked at once; subdirectories are queued on
+        //     the pool while fewer than walk.maxOpenFiles directories are open, and
+        //     removed on the calling thread otherwise. The caller has already counted
+        //     the directory in parent->pending.
+        //
+        static void RemoveAt(RemoveContext& context, const std::shared_ptr<RemoveNode>& parent, string path, size_t nameOffset)
+        {
+            if (context.IsCancelled()) {
+                RemoveComplete(context, parent);
+                return;
+            }
+
+            int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+            int fd = (parent) ? openat(parent->fd, path.c_str() + nameOffset, flags)
+                              : open(path.c_str(), flags);
+            if (fd < 0) {
+                context.ReportError(path, errno);
+                RemoveComplete(context, parent);
+                return;
+            }
+            if (context.options.walk.sameFileSystem) {
+                struct stat sb;
+                if (fstat(fd, &sb) != 0 || sb.st_dev != context.rootDevice) {
+                    context.ReportError(path, (sb.st_dev != context.rootDevice) ? EXDEV : errno);
+                    close(fd);
+                    RemoveComplete(context, parent);
+                    return;
+                }
+            }
+            context.openCount++;
+
+            auto node = std::make_shared<RemoveNode>();
+            node->fd = fd;
+            node->parent = parent;
+            node->path = std::move(path);
+            node->nameOffset = nameOffset;
+
+            //
+            // The directory is read completely before anything in it is removed, as
+            // removing entries while reading can make the reader skip some.
+            //
+            ItsDirectoryListing listing;
+            {
+                ItsDirectoryReader reader(fd, context.options.walk.bufferSize, false);
+                for (auto& entry : reader) {
+                    listing.Append(entry);
+                }
+                if (reader.GetError() != 0) {
+                    context.ReportError(node->path, reader.GetError());
+                }
+            }
+
+            for (size_t i = 0; i < listing.size() && !context.IsCancelled(); i++)
+            {
+                const char* name = listing.GetName(i);
+                ItsDirectoryEntryType type = listing[i].type;
+                if (type == ItsDirectoryEntryType::Unknown) {
+                    struct stat sb;
+                    if (fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(sb.st_mode)) {
+                        type = ItsDirectoryEntryType::Directory;
+                    }
+                }
+
+                if (type != ItsDirectoryEntryType::Directory) {
+                    if (unlinkat(fd, name, 0) == 0) {
+                        context.filesRemoved++;
+                    }
+                    else {
+                        context.ReportError(node->path + "/" + name, errno);
+                    }
+                    continue;
+                }
+
+                string child = node->path;
+                if (child.back() != '/') {
+                    child.push_back('/');
+                }
+                size_t offset = child.size();
+                child.append(name);
+
+                node->pending++;
+                if (context.openCount.load() < context.options.walk.maxOpenFiles) {
+                    context.pool.Enqueue([&context, node, child = std::move(child), offset]() mutable {
+                        RemoveAt(context, node, std::move(child), offset);
+                    });
+                }
+                else {
+                    RemoveAt(context, node, std::move(child), offset);
+                }
+            }
+
+            RemoveComplete(context, node);
+        }
+
+        //
+        // Method: RemoveComplete
+        //
+        // (i) drops one pending count of node. The last one closes the directory and
+        //     removes it from its parent, which may in turn complete the parent.
+        //
+        static void RemoveComplete(RemoveContext& context, std::shared_ptr<RemoveNode> node)
+        {
+            while (node && --node->pending == 0)
+            {
+                close(node->fd);
+                context.openCount--;
+
+                std::shared_ptr<RemoveNode> parent = std::move(node->parent);
+                if (parent && !context.IsCancelled()) {
+                    if (unlinkat(parent->fd, node->path.c_str() + node->nameOffset, AT_REMOVEDIR) == 0) {
+                        context.directoriesRemoved++;
+                    }
+                    else {
+                        context.ReportError(node->path, errno);
+                    }
+                }
+                node = std::move(parent);
+            }
+        }
+    };
+
+    //
+    // class: ItsDirectoryHandle
+    //
+    // (i): Open directory used as the base of openat, fstatat, unlinkat, renameat and
+    //      mkdirat, so names are resolved relative to it instead of walking the full
+    //      path on every call. macOS has no O_PATH; the directory is opened
+    //      O_RDONLY | O_DIRECTORY.
+    //
+    class ItsDirectoryHandle
+    {
+        private:
+        unique_file_handle m_fd;
+        string m_path;
+
+        protected:
+        public:
+        ItsDirectoryHandle()
+        {
+        }
+
+        //
+        // Method: ItsDirectoryHandle
+        //
+        // (i) takes ownership of fd, an open directory.
+        //
+        explicit ItsDirectoryHandle(int fd)
+            : m_fd(fd)
+        {
+        }
+
+        ItsDirectoryHandle(const ItsDirectoryHandle&) = delete;
+        ItsDirectoryHandle& operator=(const ItsDirectoryHandle&) = delete;
+
+        bool Open(string path)
+        {
+            if (this->m_fd.IsValid()) {
+                errno = EBUSY;
+                return false;
+            }
+            this->m_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (this->m_fd.IsInvalid()) {
+                return false;
+            }
+            this->m_path = path;
+            return true;
+        }
+
+        //
+        // Method: OpenDirectory
+        //
+        // (i) opens the subdirectory name as another handle. Symbolic links are not followed.
+        //
+        bool OpenDirectory(string name, ItsDirectoryHandle& directory) const
+        {
+            if (directory.m_fd.IsValid()) {
+                errno = EBUSY;
+                return false;
+            }
+            directory.m_fd = openat(this->m_fd.p(), name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (directory.m_fd.IsInvalid()) {
+                return false;
+            }
+            directory.m_path = this->m_path + "/" + name;
+            return true;
+        }
+
+        //
+        // Method: OpenFile
+        //
+        // (i) opens an existing file relative to the directory. flags as ItsFile::OpenExisting.
+        //
+        bool OpenFile(string name, string flags, ItsFile& file) const
+        {
+            return file.OpenExistingAt(this->m_fd.p(), name, flags);
+        }
+
+        //
+        // Method: OpenOrCreateFile
+        //
+        // (i) flags and mode as ItsFile::OpenOrCreate.
+        //
+        bool OpenOrCreateFile(string name, string flags, int mode, ItsFile& file) const
+        {
+            return file.OpenOrCreateAt(this->m_fd.p(), name, flags, mode);
+        }
+
+        //
+        // Method: OpenFile
+        //
+        // (i) openat with raw open(2) flags, for callers that manage the descriptor.
+        //
+        bool OpenFile(string name, int flags, unique_file_handle& fd, int mode = 0) const
+        {
+            fd = openat(this->m_fd.p(), name.c_str(), flags | O_CLOEXEC, mode);
+            return fd.IsValid();
+        }
+
+        bool Stat(string name, struct stat& sb, bool followSymlinks = false) const
+        {
+            return (fstatat(this->m_fd.p(), name.c_str(), &sb, followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW) == 0);
+        }
+
+        bool Exists(string name) const
+        {
+            struct stat sb;
+            return this->Stat(name, sb);
+        }
+
+        //
+        // Method: Remove
+        //
+        // (i) unlinks a file or symbolic link, or removes an empty directory.
+        //
+        bool Remove(string name, bool isDirectory = false) const
+        {
+            return (unlinkat(this->m_fd.p(), name.c_str(), isDirectory ? AT_REMOVEDIR : 0) == 0);
+        }
+
+        bool Rename(string from, string to) const
+        {
+            return (renameat(this->m_fd.p(), from.c_str(), this->m_fd.p(), to.c_str()) == 0);
+        }
+
+        bool Rename(string from, const ItsDirectoryHandle& target, string to) const
+        {
+            return (renameat(this->m_fd.p(), from.c_str(), target.m_fd.p(), to.c_str()) == 0);
+        }
+
+        bool CreateDirectory(string name, int mode) const
+        {
+            return (mkdirat(this->m_fd.p(), name.c_str(), mode) == 0);
+        }
+
+        //
+        // Method: Enumerate
+        //
+        // (i) lists the directory with ItsDirectoryReader. A new descriptor is opened for
+        //     the listing so the handle itself keeps no read position.
+        //
+        bool Enumerate(vector<ItsDirectoryEntry>& entries) const
+        {
+            ItsDirectoryReader reader(openat(this->m_fd.p(), ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+            if (!reader.IsValid()) {
+                return false;
+            }
+            for (auto& entry : reader) {
+                entries.push_back(ItsDirectoryEntry{ string(entry.name), entry.type, entry.inode });
+            }
+            if (reader.GetError() != 0) {
+                errno = reader.GetError();
+                return false;
+            }
+            return true;
+        }
+
+        int GetFd() const
+        {
+            return this->m_fd.p();
+        }
+
+        string GetPath() const
+        {
+            return this->m_path;
+        }
+
+        bool Close()
+        {
+            this->m_path.clear();
+            return this->m_fd.Close();
+        }
+
+        bool IsValid() const
+        {
+            return this->m_fd.IsValid();
+        }
+    };
+
+    //
+    // struct: ItsDirectorySnapshotOptions
+    //
+    // (i): options for ItsDirectorySnapshot::Capture. hash stores a content digest of
+    //      every regular file, which makes Capture read the whole tree.
+    //
+    struct ItsDirectorySnapshotOptions
+    {
+        ItsDirectoryWalkOptions walk;
+        bool hash = false;
+        ItsHashAlgorithm hashAlgorithm = ItsHashAlgorithm::XxHash64;
+    };
+
+    //
+    // struct: ItsDirectorySnapshotEntry
+    //
+    // (i): entry of an ItsDirectorySnapshot. path is relative to the snapshot root and
+    //      points into the snapshot. mtime is in nanoseconds since the epoch.
+    //
+    struct ItsDirectorySnapshotEntry
+    {
+        std::string_view path;
+        ItsDirectoryEntryType type = ItsDirectoryEntryType::Unknown;
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        uint64_t hash = 0;
+    };
+
+    //
+    // struct: ItsDirectorySnapshotDiff
+    //
+    // (i): result of ItsDirectorySnapshot::Diff. renamed holds (from, to) pairs.
+    //
+    struct ItsDirectorySnapshotDiff
+    {
+        vector<string> created;
+        vector<string> deleted;
+        vector<string> modified;
+        vector<std::pair<string, string>> renamed;
+    };
+
+    //
+    // class: ItsDirectorySnapshot
+    //
+    // (i): Index of a directory tree: path, type, inode, size, mtime and optionally a
+    //      content hash per entry, sorted by path. The file format is the in-memory
+    //      format, so Open only maps the file with ItsMappedFile and checks the header:
+    //
+    //      Header   64 bytes   "ITSSNAP1", version, flags, counts and offsets
+    //      Records  48 bytes   one per entry, sorted by path
+    //      Names               relative paths, null terminated, in record order
+    //
+    //      The file uses the byte order of the machine that wrote it.
+    //
+    class ItsDirectorySnapshot
+    {
+        private:
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t flags;
+            uint64_t entryCount;
+            uint64_t entriesOffset;
+            uint64_t namesOffset;
+            uint64_t namesSize;
+            uint32_t hashAlgorithm;
+            uint32_t reserved1;
+            uint64_t reserved2;
+        };
+
+        struct Record
+        {
+            uint64_t inode;
+            uint64_t size;
+            int64_t mtime;
+            uint64_t hash;
+            uint64_t pathOffset;
+            uint32_t pathLength;
+            uint8_t type;
+            uint8_t reserved[3];
+        };
+
+        static_assert(sizeof(Header) == 64, "ItsDirectorySnapshot header must be 64 bytes");
+        static_assert(sizeof(Record) == 48, "ItsDirectorySnapshot record must be 48 bytes");
+
+        static constexpr uint32_t Version = 1;
+        static constexpr uint32_t FlagHashes = 1;
+
+        ItsMappedFile m_mapped;
+        vector<uint64_t> m_buffer;
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+        uint64_t m_errors = 0;
+
+        protected:
+        const Header& GetHeader() const
+        {
+            return *reinterpret_cast<const Header*>(this->m_data);
+        }
+
+        const Record& GetRecord(size_t index) const
+        {
+            return reinterpret_cast<const Record*>(this->m_data + this->GetHeader().entriesOffset)[index];
+        }
+
+        bool Validate() const
+        {
+            if (this->m_data == nullptr || this->m_size < sizeof(Header)) {
+                return false;
+            }
+            const Header& header = this->GetHeader();
+            if (memcmp(header.magic, "ITSSNAP1", 8) != 0 || header.version != Version) {
+                return false;
+            }
+            if (header.entriesOffset % alignof(Record) != 0 || header.entriesOffset > this->m_size ||
+                header.entryCount > (this->m_size - header.entriesOffset) / sizeof(Record)) {
+                return false;
+            }
+            if (header.namesOffset > this->m_size || header.namesSize > this->m_size - header.namesOffset) {
+                return false;
+            }
+            return true;
+        }
+
+        static bool IsSame(const ItsDirectorySnapshotEntry& a, const ItsDirectorySnapshotEntry& b, bool compareHashes)
+        {
+            if (a.type != b.type || a.inode != b.inode) {
+                return false;
+            }
+            if (a.type == ItsDirectoryEntryType::Directory) {
+                return true;
+            }
+            return (a.size == b.size && a.mtime == b.mtime && (!compareHashes || a.hash == b.hash));
+        }
+
+        public:
+        ItsDirectorySnapshot() = default;
+        ItsDirectorySnapshot(const ItsDirectorySnapshot&) = delete;
+        ItsDirectorySnapshot& operator=(const ItsDirectorySnapshot&) = delete;
+
+        //
+        // Method: Capture
+        //
+        // (i) snapshots the tree under root with a parallel ItsDirectory::Walk. Each entry
+        //     is stat'ed once with fstatat relative to its parent directory. Entries that
+        //     cannot be read are left out and counted in GetErrors.
+        //
+        bool Capture(string root, const ItsDirectorySnapshotOptions& options = ItsDirectorySnapshotOptions())
+        {
+            constexpr size_t ShardCount = 64;
+            struct Pending
+            {
+                Record record;
+                uint32_t shard;
+            };
+            struct Shard
+            {
+                std::mutex mutex;
+                vector<char> names;
+                vector<Pending> entries;
+            };
+
+            this->Close();
+
+            while (root.size() > 1 && root.back() == '/') {
+                root.pop_back();
+            }
+            size_t prefix = root.size() + ((root == "/") ? 0 : 1);
+
+            vector<Shard> shards(ShardCount);
+            std::atomic<uint64_t> errors{0};
+
+            ItsDirectoryWalkResult walkResult;
+            bool bResult = ItsDirectory::Walk(root, [&](const ItsDirectoryWalkEntry& entry) {
+                const char* name = entry.path.data() + (entry.path.size() - entry.name.size());
+                struct stat st;
+                if (fstatat(entry.dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    errors++;
+                    return;
+                }
+
+                uint64_t digest = 0;
+                if (options.hash && S_ISREG(st.st_mode)) {
+                    unique_file_handle fd(openat(entry.dirFd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+                    if (fd.IsInvalid() || !ItsFile::Hash(fd.p(), options.hashAlgorithm, &digest)) {
+                        errors++;
+                        return;
+                    }
+                }
+
+                Pending pending = {};
+                pending.record.inode = static_cast<uint64_t>(st.st_ino);
+                pending.record.size = static_cast<uint64_t>(st.st_size);
+                pending.record.mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+                pending.record.hash = digest;
+                pending.record.type = static_cast<uint8_t>(S_ISREG(st.st_mode) ? ItsDirectoryEntryType::File
+                                                         : S_ISDIR(st.st_mode) ? ItsDirectoryEntryType::Directory
+                                                         : S_ISLNK(st.st_mode) ? ItsDirectoryEntryType::Symlink
+                                                         : ItsDirectoryEntryType::Other);
+
+                std::string_view relative = entry.path.substr(prefix);
+                pending.shard = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()) % ShardCount);
+                auto& shard = shards[pending.shard];
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                pending.record.pathOffset = shard.names.size();
+                pending.record.pathLength = static_cast<uint32_t>(relative.size());
+                shard.names.insert(shard.names.end(), relative.begin(), relative.end());
+                shard.entries.push_back(pending);
+            }, options.walk, &walkResult);
+
+            if (!bResult) {
+                return false;
+            }
+
+            vector<Pending> entries;
+            size_t namesSize = 0;
+            for (auto& shard : shards) {
+                entries.insert(entries.end(), shard.entries.begin(), shard.entries.end());
+                namesSize += shard.names.size();
+                shard.entries = vector<Pending>();
+            }
+            namesSize += entries.size();
+
+            auto pathOf = [&shards](const Pending& p) {
+                return std::string_view(shards[p.shard].names.data() + p.record.pathOffset, p.record.pathLength);
+            };
+            std::sort(entries.begin(), entries.end(), [&pathOf](const Pending& a, const Pending& b) {
+                return pathOf(a) < pathOf(b);
+            });
+
+            size_t entriesOffset = sizeof(Header);
+            size_t namesOffset = entriesOffset + entries.size() * sizeof(Record);
+            size_t total = namesOffset + namesSize;
+            this->m_buffer.assign((total + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+            uint8_t* data = reinterpret_cast<uint8_t*>(this->m_buffer.data());
+
+            Header header = {};
+            memcpy(header.magic, "ITSSNAP1", 8);
+            header.version = Version;
+            header.flags = options.hash ? FlagHashes : 0;
+            header.entryCount = entries.size();
+            header.entriesOffset = entriesOffset;
+            header.namesOffset = namesOffset;
+            header.namesSize = namesSize;
+            header.hashAlgorithm = static_cast<uint32_t>(options.hashAlgorithm);
+            memcpy(data, &header, sizeof(header));
+
+            Record* records = reinterpret_cast<Record*>(data + entriesOffset);
+            char* names = reinterpret_cast<char*>(data + namesOffset);
+            size_t nameOffset = 0;
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                std::string_view path = pathOf(entries[i]);
+                memcpy(names + nameOffset, path.data(), path.size());
+                records[i] = entries[i].record;
+                records[i].pathOffset = nameOffset;
+                nameOffset += path.size() + 1;
+            }
+
+            this->m_data = data;
+            this->m_size = total;
+            this->m_errors = errors + walkResult.errors;
+            return true;
+        }
+
+        //
+        // Method: Open
+        //
+        // (i) maps a snapshot written by Save. Only the header is checked.
+        //
+        bool Open(const string& filename)
+        {
+            this->Close();
+            if (!this->m_mapped.OpenExisting(filename, ItsMappedFileAccess::ReadOnly)) {
+                return false;
+            }
+            this->m_mapped.Advise(ItsMappedFileAdvice::WillNeed);
+            this->m_data = this->m_mapped.GetData();
+            this->m_size = this->m_mapped.GetSize();
+            if (!this->Validate()) {
+                this->Close();
+                errno = EINVAL;
+                return false;
+            }
+            return true;
+        }
+
+        //
+        // Method: Save
+        //
+        // (i) writes the snapshot with ItsFile::ReplaceAtomic.
+        //
+        bool Save(const string& filename, int mode) const
+        {
+            if (this->m_data == nullptr) {
+                errno = EINVAL;
+                return false;
+            }
+            return ItsFile::ReplaceAtomic(filename, this->m_data, this->m_size, mode);
+        }
+
+        void Close()
+        {
+            this->m_mapped.Close();
+            this->m_buffer = vector<uint64_t>();
+            this->m_data = nullptr;
+            this->m_size = 0;
+            this->m_errors = 0;
+        }
+
+        size_t size() const
+        {
+            return (this->m_data != nullptr) ? static_cast<size_t>(this->GetHeader().entryCount) : 0;
+        }
+
+        bool HasHashes() const
+        {
+            return (this->m_data != nullptr && (this->GetHeader().flags & FlagHashes) != 0);
+        }
+
+        uint64_t GetErrors() const
+        {
+            return this->m_errors;
+        }
 
-        static bool SetMode(string filename, int mode)
+        ItsDirectorySnapshotEntry operator[](size_t index) const
         {
-            if (!ItsFile::Exists(filename))
-            {
-                return false;
-            }
+            const Header& header = this->GetHeader();
+            const Record& record = this->GetRecord(index);
 
-            struct stat stat1;
-            if (chmod(filename.c_str(), mode) != 0)
-            {
-                return false;
+            ItsDirectorySnapshotEntry entry;
+            if (record.pathOffset < header.namesSize && record.pathLength <= header.namesSize - record.pathOffset) {
+                entry.path = std::string_view(reinterpret_cast<const char*>(this->m_data + header.namesOffset + record.pathOffset), record.pathLength);
             }
-            return true;
+            entry.type = static_cast<ItsDirectoryEntryType>(record.type);
+            entry.inode = record.inode;
+            entry.size = record.size;
+            entry.mtime = record.mtime;
+            entry.hash = record.hash;
+            return entry;
         }
 
-
-        static int CreateMode(string user, string group, string other)
+        //
+        // Method: Find
+        //
+        // (i) binary search by relative path.
+        //
+        bool Find(std::string_view path, ItsDirectorySnapshotEntry& entry) const
         {
-            int mode(0);
-
-            if (user.size() > 0)
+            size_t low = 0;
+            size_t high = this->size();
+            while (low < high)
             {
-                if (user.find('r',0) != string::npos) {
-                    mode |= S_IRUSR;
-                }
-                if (user.find('w',0) != string::npos) {
-                    mode |= S_IWUSR;
+                size_t middle = low + (high - low) / 2;
+                ItsDirectorySnapshotEntry candidate = (*this)[middle];
+                if (candidate.path < path) {
+                    low = middle + 1;
                 }
-                if (user.find('x',0) != string::npos) {
-                    mode |= S_IXUSR;
+                else {
+                    high = middle;
                 }
             }
-
-            if (group.size() > 0)
-            {
-                    if (group.find('r',0) != string::npos) {
-                        mode |= S_IRGRP;
-                    }
-                    if (group.find('w',0) != string::npos) {
-                        mode |= S_IWGRP;
-                    }
-                    if (group.find('x',0) != string::npos) {
-                        mode |= S_IXGRP;
-                    }
+            if (low < this->size() && (*this)[low].path == path) {
+                entry = (*this)[low];
+                return true;
             }
+            return false;
+        }
 
-            if (other.size() > 0)
+        //
+        // Method: Diff
+        //
+        // (i) compares two snapshots with a single merge of the sorted records. An entry
+        //     that disappeared and one that appeared with the same inode, type, size and
+        //     mtime are reported as a rename. Hashes are compared, for modifications and
+        //     renames, when both have them and they were made with the same algorithm.
+        //
+        static void Diff(const ItsDirectorySnapshot& before, const ItsDirectorySnapshot& after, ItsDirectorySnapshotDiff& diff)
+        {
+            diff = ItsDirectorySnapshotDiff();
+            bool compareHashes = before.HasHashes() && after.HasHashes() &&
+                                 before.GetHeader().hashAlgorithm == after.GetHeader().hashAlgorithm;
+
+            vector<size_t> deleted;
+            vector<size_t> created;
+            size_t i = 0;
+            size_t j = 0;
+            while (i < before.size() || j < after.size())
             {
-                if (other.find('r',0) != string::npos) {
-                        mode |= S_IROTH;
+                if (j == after.size() || (i < before.size() && before[i].path < after[j].path)) {
+                    deleted.push_back(i++);
                 }
-                if (other.find('w',0) != string::npos) {
-                        mode |= S_IWOTH;
+                else if (i == before.size() || after[j].path < before[i].path) {
+                    created.push_back(j++);
                 }
-                if (other.find('x',0) != string::npos) {
-                        mode |= S_IXOTH;
+                else {
+                    if (!IsSame(before[i], after[j], compareHashes)) {
+                        diff.modified.emplace_back(after[j].path);
+                    }
+                    i++;
+                    j++;
                 }
             }
 
-            return mode;
-        }
-
-        static bool Shred(string filename, bool alsoDelete) 
-        {    
-            if (!ItsFile::Exists(filename))
-            {
-                return false;
-            }
-
-            const size_t fileSize = ItsFile::GetFileSize(filename);
-            if (fileSize == 0 ) {
-                return false;
+            std::unordered_map<uint64_t, size_t> deletedByInode;
+            deletedByInode.reserve(deleted.size());
+            for (size_t d : deleted) {
+                deletedByInode.emplace(before[d].inode, d);
             }
 
-            ItsFile f;
-            f.OpenExisting(filename, "rw");
-            if (f.IsInvalid())
+            vector<bool> renamedFrom(before.size(), false);
+            for (size_t c : created)
             {
-                return false;
-            }
-
-            const uint32_t bufferSize = 2048;
-            size_t bytesWritten = 0;
-            size_t totalWritten = 0;
-            const unique_ptr<uint8_t[]> pdata = make_unique<uint8_t[]>(bufferSize);
-            for (uint32_t i = 0; i < bufferSize; i++){
-                pdata[i] = 0xFF;
-            }
-            f.SetPosFromBeg(0);
-            while ( totalWritten < fileSize ) {
-                f.Write(static_cast<const void*>(pdata.get()), ((fileSize-totalWritten) > bufferSize) ? bufferSize : (fileSize-totalWritten), &bytesWritten);
-                totalWritten += bytesWritten;
+                ItsDirectorySnapshotEntry to = after[c];
+                auto it = deletedByInode.find(to.inode);
+                if (it != deletedByInode.end() && !renamedFrom[it->second] && IsSame(before[it->second], to, compareHashes)) {
+                    renamedFrom[it->second] = true;
+                    diff.renamed.emplace_back(string(before[it->second].path), string(to.path));
+                    continue;
+                }
+                diff.created.emplace_back(to.path);
             }
-            f.Close();
-
-            if (alsoDelete) {
-                return ItsFile::Delete(filename);
+            for (size_t d : deleted) {
+                if (!renamedFrom[d]) {
+                    diff.deleted.emplace_back(before[d].path);
+                }
             }
-
-            return true;
         }
 
-        static bool ShredAndDelete(string filename) 
+        //
+        // Method: Diff
+        //
+        // (i) compares a snapshot with the live tree under root.
+        //
+        static bool Diff(const ItsDirectorySnapshot& before, const string& root, ItsDirectorySnapshotDiff& diff, const ItsDirectorySnapshotOptions& options = ItsDirectorySnapshotOptions())
         {
-            return ItsFile::Shred(filename,true);
+            ItsDirectorySnapshot live;
+            if (!live.Capture(root, options)) {
+                return false;
+            }
+            Diff(before, live, diff);
+            return true;
         }
     };
 
@@ -1136,7 +6986,7 @@ namespace ItSoftware::macOS::Core
         function<void(ItsFileMonitorEvent&)> m_func;
         FSEventStreamRef m_stream;
         FSEventStreamCallback m_callback;
-        FSEventStreamContext* m_callbackContext = nullptr; // put stream specific data here
+        FSEventStreamContext m_callbackContext{}; // info carries this to MonitorCallback
         CFStringRef m_refPathname;
         CFArrayRef m_pathsToWatch;
         CFAbsoluteTime m_latency = 0.0; // latency in seconds
@@ -1145,7 +6995,6 @@ namespace ItSoftware::macOS::Core
         bool m_bPaused;
         bool m_bStopped;
         uint32_t m_mask;
-        inline static vector<ItsFileMonitor*> s_objects{};
     protected:
         void ExecuteDispatchThread() {
             /*
@@ -1197,28 +7046,23 @@ namespace ItSoftware::macOS::Core
             const FSEventStreamEventFlags eventFlags[],
             const FSEventStreamEventId eventIds[])
         {
-            for ( auto obj : ItsFileMonitor::s_objects ) {
-                if ( obj->m_stream == streamRef ) {
-                    if ( obj->m_bStopped ) {
-                        CFRunLoopStop(CFRunLoopGetCurrent());
-                        return;
-                    }
-                    if ( obj->m_bPaused ) {
-                        return;
-                    }
+            ItsFileMonitor* obj = reinterpret_cast<ItsFileMonitor*>(clientCallBackInfo);
+            if ( obj->m_bStopped ) {
+                CFRunLoopStop(CFRunLoopGetCurrent());
+                return;
+            }
+            if ( obj->m_bPaused ) {
+                return;
+            }
 
-                    char **paths = reinterpret_cast<char **>(eventPaths);
-                    for (int i = 0; i < numEvents; i++) {
-                        ItsFileMonitorEvent event{0};
-                        event.eventId = eventIds[i];
-                        event.eventFlag = eventFlags[i];
-                        event.path = paths[i];
-                        
-                        obj->m_func(event);
-                    }
-                    
-                    break;
-                }
+            char **paths = reinterpret_cast<char **>(eventPaths);
+            for (int i = 0; i < numEvents; i++) {
+                ItsFileMonitorEvent event{0};
+                event.eventId = eventIds[i];
+                event.eventFlag = eventFlags[i];
+                event.path = paths[i];
+                
+                obj->m_func(event);
             }
         }
 
@@ -1240,6 +7084,7 @@ namespace ItSoftware::macOS::Core
                     1. The application creates a stream by calling FSEventStreamCreate or FSEventStreamCreateRelativeToDevice.
                 */
                 this->m_callback = &ItsFileMonitor::MonitorCallback;
+                this->m_callbackContext = {0, this, NULL, NULL, NULL};
                 this->m_refPathname = CFStringCreateWithCString(kCFAllocatorDefault, pathname.c_str(), kCFStringEncodingUTF8);
                 this->m_pathsToWatch = CFArrayCreate(nullptr, reinterpret_cast<void**>(&this->m_refPathname),1,nullptr);
                 
@@ -1247,14 +7092,13 @@ namespace ItSoftware::macOS::Core
                 this->m_stream = FSEventStreamCreate(
                                             kCFAllocatorDefault,
                                             this->m_callback,
-                                            this->m_callbackContext,
+                                            &this->m_callbackContext,
                                             this->m_pathsToWatch,
                                             kFSEventStreamEventIdSinceNow,
                                             this->m_latency,
                                             this->m_mask);
 
                 if ( this->m_stream != nullptr ) {
-                    ItsFileMonitor::s_objects.push_back(this);
                     this->m_thread = thread(&ItsFileMonitor::ExecuteDispatchThread, this);
                 }
             }
@@ -1275,6 +7119,10 @@ namespace ItSoftware::macOS::Core
         {
             return this->m_bStopped;
         }
+        bool IsRunning() const
+        {
+            return (this->m_thread.joinable() && !this->m_bStopped);
+        }
         ~ItsFileMonitor()
         {
             this->Stop();
@@ -1282,11 +7130,380 @@ namespace ItSoftware::macOS::Core
             if ( this->m_thread.joinable() ) {
                 this->m_thread.join();
             }
+        }
+    };
+
+    //
+    // struct: ItsMetadataCacheOptions
+    //
+    // (i): options for ItsMetadataCache. Entries under a root added with AddRoot are
+    //      kept coherent by an ItsFileMonitor and expire after monitoredTtl; anything
+    //      else, or a root whose monitor could not start, expires after ttl.
+    //
+    struct ItsMetadataCacheOptions
+    {
+        std::chrono::milliseconds ttl{1000};
+        std::chrono::milliseconds monitoredTtl{60000};
+        size_t maxEntries = 100000;
+    };
+
+    //
+    // struct: ItsMetadataCacheStatistics
+    //
+    struct ItsMetadataCacheStatistics
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t invalidations = 0;
+        size_t entries = 0;
+    };
+
+    //
+    // class: ItsMetadataCache
+    //
+    // (i): In-process cache of stat results (including negative "does not exist"
+    //      results) and directory listings. Thread safe.
+    //
+    class ItsMetadataCache
+    {
+        private:
+        using Clock = std::chrono::steady_clock;
+
+        struct StatEntry
+        {
+            bool exists;
+            struct stat sb;
+            Clock::time_point expires;
+        };
+
+        struct ListingEntry
+        {
+            std::shared_ptr<const vector<ItsDirectoryEntry>> entries;
+            Clock::time_point expires;
+        };
+
+        struct Root
+        {
+            string path;
+            string realPath;
+            unique_ptr<ItsFileMonitor> monitor;
+        };
+
+        ItsMetadataCacheOptions m_options;
+        mutable std::shared_mutex m_mutex;
+        std::unordered_map<string, StatEntry> m_stats;
+        std::unordered_map<string, ListingEntry> m_listings;
+        vector<unique_ptr<Root>> m_roots;
+        std::atomic<uint64_t> m_generation{0};
+        mutable std::atomic<uint64_t> m_hits{0};
+        mutable std::atomic<uint64_t> m_misses{0};
+        std::atomic<uint64_t> m_invalidations{0};
+
+        protected:
+        static string Normalize(string path)
+        {
+            while (path.size() > 1 && path.back() == '/') {
+                path.pop_back();
+            }
+            return path;
+        }
+
+        static string GetParent(const string& path)
+        {
+            size_t slash = path.rfind('/');
+            if (slash == string::npos) {
+                return string();
+            }
+            return (slash == 0) ? string("/") : path.substr(0, slash);
+        }
+
+        //
+        // (i) true if path is root or below it, on a '/' boundary.
+        //
+        static bool IsUnder(const string& path, const string& root)
+        {
+            return (path.compare(0, root.size(), root) == 0 &&
+                    (path.size() == root.size() || path[root.size()] == '/' || root == "/"));
+        }
+
+        Clock::time_point GetExpiry(const string& path) const
+        {
+            for (auto& root : this->m_roots) {
+                if (root->monitor && root->monitor->IsRunning() && IsUnder(path, root->path)) {
+                    return Clock::now() + this->m_options.monitoredTtl;
+                }
+            }
+            return Clock::now() + this->m_options.ttl;
+        }
+
+        void Trim()
+        {
+            if (this->m_stats.size() + this->m_listings.size() <= this->m_options.maxEntries) {
+                return;
+            }
+            auto now = Clock::now();
+            for (auto it = this->m_stats.begin(); it != this->m_stats.end();) {
+                it = (it->second.expires <= now) ? this->m_stats.erase(it) : std::next(it);
+            }
+            for (auto it = this->m_listings.begin(); it != this->m_listings.end();) {
+                it = (it->second.expires <= now) ? this->m_listings.erase(it) : std::next(it);
+            }
+            if (this->m_stats.size() + this->m_listings.size() > this->m_options.maxEntries) {
+                this->m_stats.clear();
+                this->m_listings.clear();
+            }
+        }
+
+        void ErasePrefix(const string& prefix)
+        {
+            string children = (prefix == "/") ? prefix : prefix + "/";
+            auto under = [&](const string& key) {
+                return key == prefix || key.compare(0, children.size(), children) == 0;
+            };
+            for (auto it = this->m_stats.begin(); it != this->m_stats.end();) {
+                it = under(it->first) ? this->m_stats.erase(it) : std::next(it);
+            }
+            for (auto it = this->m_listings.begin(); it != this->m_listings.end();) {
+                it = under(it->first) ? this->m_listings.erase(it) : std::next(it);
+            }
+        }
+
+        //
+        // Method: OnEvent
+        //
+        // (i) maps the real path FSEvents reports back to the path the root was added
+        //     with, then drops the entry and its parent directory. Dropped events,
+        //     directories that were renamed or removed and a changed root drop the
+        //     whole subtree.
+        //
+        void OnEvent(const Root& root, const ItsFileMonitorEvent& event)
+        {
+            string path = Normalize(event.path);
+            if (IsUnder(path, root.realPath)) {
+                path = root.path + path.substr(root.realPath.size());
+            }
+
+            FSEventStreamEventFlags subtreeFlags = kFSEventStreamEventFlagMustScanSubDirs | kFSEventStreamEventFlagUserDropped |
+                                                   kFSEventStreamEventFlagKernelDropped | kFSEventStreamEventFlagRootChanged;
+            bool subtree = (event.eventFlag & subtreeFlags) != 0 ||
+                           ((event.eventFlag & kFSEventStreamEventFlagItemIsDir) != 0 &&
+                            (event.eventFlag & (kFSEventStreamEventFlagItemRemoved | kFSEventStreamEventFlagItemRenamed)) != 0);
+
+            if ((event.eventFlag & (kFSEventStreamEventFlagUserDropped | kFSEventStreamEventFlagKernelDropped | kFSEventStreamEventFlagRootChanged)) != 0) {
+                path = root.path;
+            }
+            this->Invalidate(path, subtree);
+        }
+
+        public:
+        explicit ItsMetadataCache(const ItsMetadataCacheOptions& options = ItsMetadataCacheOptions())
+            : m_options(options)
+        {
+        }
+
+        ItsMetadataCache(const ItsMetadataCache&) = delete;
+        ItsMetadataCache& operator=(const ItsMetadataCache&) = delete;
+
+        ~ItsMetadataCache()
+        {
+            //
+            // Stop the monitors before the maps they invalidate go away.
+            //
+            this->m_roots.clear();
+        }
+
+        //
+        // Method: AddRoot
+        //
+        // (i) subscribes an ItsFileMonitor to root. Returns false if the monitor could not
+        //     be started; entries under root then fall back to the ttl.
+        //
+        bool AddRoot(string path)
+        {
+            auto root = make_unique<Root>();
+            root->path = Normalize(path);
+
+            char realPath[PATH_MAX];
+            root->realPath = (realpath(root->path.c_str(), realPath) != nullptr) ? Normalize(realPath) : root->path;
+
+            Root* r = root.get();
+            root->monitor = make_unique<ItsFileMonitor>(root->path, ItsFileMonitorMask::FileEvents | ItsFileMonitorMask::WatchRoot, [this, r](ItsFileMonitorEvent& event) {
+                this->OnEvent(*r, event);
+            });
+            bool bResult = root->monitor->IsRunning();
+
+            std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+            this->m_roots.push_back(std::move(root));
+            return bResult;
+        }
+
+        //
+        // Method: Stat
+        //
+        // (i) cached stat(2). Returns false with errno = ENOENT for a cached negative
+        //     result. Errors other than ENOENT and ENOTDIR are not cached.
+        //
+        bool Stat(string path, struct stat& sb)
+        {
+            path = Normalize(path);
+            {
+                std::shared_lock<std::shared_mutex> lock(this->m_mutex);
+                auto it = this->m_stats.find(path);
+                if (it != this->m_stats.end() && it->second.expires > Clock::now()) {
+                    this->m_hits++;
+                    if (!it->second.exists) {
+                        errno = ENOENT;
+                        return false;
+                    }
+                    sb = it->second.sb;
+                    return true;
+                }
+            }
+
+            this->m_misses++;
+            uint64_t generation = this->m_generation;
+            StatEntry entry;
+            entry.exists = (stat(path.c_str(), &entry.sb) == 0);
+            int err = errno;
+            if (!entry.exists && err != ENOENT && err != ENOTDIR) {
+                return false;
+            }
+
+            std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+            if (generation == this->m_generation) {
+                this->Trim();
+                entry.expires = this->GetExpiry(path);
+                this->m_stats[path] = entry;
+            }
+            if (!entry.exists) {
+                errno = ENOENT;
+                return false;
+            }
+            sb = entry.sb;
+            return true;
+        }
+
+        bool Exists(string path)
+        {
+            struct stat sb;
+            return this->Stat(path, sb);
+        }
+
+        bool FileExists(string path)
+        {
+            struct stat sb;
+            return (this->Stat(path, sb) && S_ISREG(sb.st_mode));
+        }
+
+        bool DirectoryExists(string path)
+        {
+            struct stat sb;
+            return (this->Stat(path, sb) && S_ISDIR(sb.st_mode));
+        }
+
+        //
+        // Method: GetListing
+        //
+        // (i) cached ItsDirectory::Enumerate. The listing is shared, not copied; nullptr
+        //     with errno set if the directory cannot be read.
+        //
+        std::shared_ptr<const vector<ItsDirectoryEntry>> GetListing(string path)
+        {
+            path = Normalize(path);
+            {
+                std::shared_lock<std::shared_mutex> lock(this->m_mutex);
+                auto it = this->m_listings.find(path);
+                if (it != this->m_listings.end() && it->second.expires > Clock::now()) {
+                    this->m_hits++;
+                    return it->second.entries;
+                }
+            }
+
+            this->m_misses++;
+            uint64_t generation = this->m_generation;
+            auto entries = std::make_shared<vector<ItsDirectoryEntry>>();
+            if (!ItsDirectory::Enumerate(path, *entries)) {
+                return nullptr;
+            }
+
+            std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+            if (generation == this->m_generation) {
+                this->Trim();
+                this->m_listings[path] = ListingEntry{ entries, this->GetExpiry(path) };
+            }
+            return entries;
+        }
+
+        vector<string> GetFiles(string path)
+        {
+            vector<string> files;
+            auto listing = this->GetListing(path);
+            if (listing) {
+                for (auto& entry : *listing) {
+                    if (entry.type == ItsDirectoryEntryType::File) {
+                        files.push_back(entry.name);
+                    }
+                }
+            }
+            return files;
+        }
+
+        vector<string> GetDirectories(string path)
+        {
+            vector<string> directories;
+            auto listing = this->GetListing(path);
+            if (listing) {
+                for (auto& entry : *listing) {
+                    if (entry.type == ItsDirectoryEntryType::Directory) {
+                        directories.push_back(entry.name);
+                    }
+                }
+            }
+            return directories;
+        }
 
-            auto itr = std::find(begin(ItsFileMonitor::s_objects), end(ItsFileMonitor::s_objects), this);
-            if ( itr != end(ItsFileMonitor::s_objects) ) {
-                ItsFileMonitor::s_objects.erase(itr);
+        //
+        // Method: Invalidate
+        //
+        // (i) drops path and the listing and stat of its parent directory, or with
+        //     subtree everything at or below path.
+        //
+        void Invalidate(string path, bool subtree = false)
+        {
+            path = Normalize(path);
+            std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+            this->m_generation++;
+            this->m_invalidations++;
+            if (subtree) {
+                this->ErasePrefix(path);
             }
+            else {
+                this->m_stats.erase(path);
+                this->m_listings.erase(path);
+            }
+            string parent = GetParent(path);
+            this->m_stats.erase(parent);
+            this->m_listings.erase(parent);
+        }
+
+        void InvalidateAll()
+        {
+            std::unique_lock<std::shared_mutex> lock(this->m_mutex);
+            this->m_generation++;
+            this->m_invalidations++;
+            this->m_stats.clear();
+            this->m_listings.clear();
+        }
+
+        ItsMetadataCacheStatistics GetStatistics() const
+        {
+            ItsMetadataCacheStatistics statistics;
+            statistics.hits = this->m_hits;
+            statistics.misses = this->m_misses;
+            statistics.invalidations = this->m_invalidations;
+            std::shared_lock<std::shared_mutex> lock(this->m_mutex);
+            statistics.entries = this->m_stats.size() + this->m_listings.size();
+            return statistics;
         }
     };
 } // namespace ItSoftware::macOS::Core